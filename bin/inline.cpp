@@ -1,15 +1,60 @@
+#include <cstring>
+#include <exception>
 #include <iostream>
-#include <iterator>
+
+#include <unistd.h>
 
 #include <lunar/parser.hpp>
 
+namespace {
+
+/*
+ * Print the deck, and again every time one of its files changes, until
+ * interrupted. Errors are reported, and the files are watched until they are
+ * fixed.
+ */
+int watch( const std::string& path, const lun::concatopts& opts ) {
+    lun::session session( path, opts );
+    for( ;; ) {
+        const auto& out = session.inlined().inlined;
+        std::cout.write( out.data(), out.size() );
+        std::cout.flush();
+
+        for( ;; ) {
+            try {
+                if( session.watch() ) break;
+            } catch( const std::exception& e ) {
+                std::cerr << e.what() << "\n";
+            }
+        }
+    }
+}
+
+}
+
 int main( int argc, char** argv ) {
+    const auto* prog = argv[ 0 ];
+    lun::concatopts opts;
+    bool watching = false;
+
+    for( ;; ) {
+        if( argc >= 3 && std::strcmp( argv[ 1 ], "--cache" ) == 0 ) {
+            opts.cache = argv[ 2 ];
+            argv += 2;
+            argc -= 2;
+        } else if( argc >= 2 && std::strcmp( argv[ 1 ], "--watch" ) == 0 ) {
+            watching = true;
+            argv += 1;
+            argc -= 1;
+        } else break;
+    }
+
     if( argc != 2 ) {
-        std::cout << "Usage: " << argv[ 0 ] << " INPUT\n";
+        std::cout << "Usage: " << prog << " [--cache DIR] [--watch] INPUT\n";
         return 1;
     }
 
-    auto il = lun::concatenate( argv[ 1 ] );
-    std::copy( il.inlined.begin(), il.inlined.end(),
-               std::ostream_iterator< char >( std::cout, "" ) );
+    if( watching ) return watch( argv[ 1 ], opts );
+
+    lun::concatenate( argv[ 1 ], STDOUT_FILENO, lun::default_chunksize, opts );
 }
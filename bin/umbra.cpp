@@ -1,9 +1,14 @@
-#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <exception>
 #include <iostream>
 #include <sstream>
-#include <streambuf>
 #include <string>
 
+#include <sys/stat.h>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
 #include <lunar/parser.hpp>
 
 struct is_end : boost::static_visitor< bool > {
@@ -66,15 +71,56 @@ std::string lun::dot( const std::vector< keyword >& kws ) {
     return stream.str();
 }
 
-int main( int , char** argv ) {
+namespace {
+
+/*
+ * Print the deck, with its includes resolved, and again every time one of
+ * its files changes, until interrupted. Only the keywords in the part of the
+ * deck that changed are parsed again.
+ */
+int watch( const std::string& filename ) {
+    lun::session session( filename );
+    for( ;; ) {
+        std::cout << lun::dot( session.keywords() ) << std::endl;
+
+        for( ;; ) {
+            try {
+                if( session.watch() ) break;
+            } catch( const std::exception& e ) {
+                std::cerr << e.what() << "\n";
+            }
+        }
+    }
+}
+
+}
+
+int main( int argc, char** argv ) {
+    if( argc == 3 && std::strcmp( argv[ 1 ], "--watch" ) == 0 )
+        return watch( argv[ 2 ] );
+
+    if( argc != 2 ) {
+        std::cout << "Usage: " << argv[ 0 ] << " [--watch] INPUT\n";
+        return 1;
+    }
+
     const std::string filename{ argv[ 1 ] };
-    std::ifstream fs( filename );
-    std::string input{ std::istreambuf_iterator< char >( fs ),
-                       std::istreambuf_iterator< char >() };
 
-    auto begin = input.cbegin();
-    auto end   = input.cend();
-    auto sec = lun::parse( begin, end );
+    /*
+     * parse straight from the mapped file, rather than reading it into a
+     * string first, so that a deck never needs more memory than its size
+     */
+    struct stat st;
+    if( stat( filename.c_str(), &st ) != 0 ) {
+        std::perror( filename.c_str() );
+        return 1;
+    }
+
+    /* an empty file can't be mapped, but is a valid (empty) deck */
+    boost::iostreams::mapped_file_source input;
+    if( st.st_size > 0 ) input.open( filename );
+
+    auto sec = lun::parse( input.begin(), input.end() );
 
     std::cout << lun::dot( sec ) << std::endl;
 }
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include <ctime>
+
+#include <lunar/parser.hpp>
+
+/*
+ * Measure the bulk path for the large GRID arrays on a synthetic ZCORN of
+ * 8 values per cell - depths with a few decimals, where about one in eight is
+ * a run of repeats, like the corners shared by neighbouring cells.
+ *
+ * The same values are read as ZCORN, by the bulk path, and as MAPAXES, by the
+ * general record lexer, both into the columnar deck with tabulate(). A
+ * billion cells is 80GB of text, so rather than parsing it, the time is
+ * projected from the throughput on the given number of cells.
+ */
+namespace {
+
+double now() {
+    timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* best of 5, not counting destroying the deck */
+template< typename F >
+double best( F f ) {
+    double t = 1e9;
+    for( int i = 0; i < 5; ++i ) {
+        lun::deck deck;
+        const auto start = now();
+        deck = f();
+        const auto stop = now();
+        t = std::min( t, stop - start );
+    }
+    return t;
+}
+
+std::string generate( std::size_t cells ) {
+    std::mt19937 gen( 1 );
+    std::uniform_int_distribution< int > depth( 200000, 300000 );
+    std::uniform_int_distribution< int > pick( 0, 7 );
+
+    std::string out;
+    std::size_t values = 0;
+    int line = 0;
+    while( values < cells * 8 ) {
+        const auto d = depth( gen );
+        const auto x = std::to_string( d / 100 ) + "." + std::to_string( d % 100 );
+
+        if( pick( gen ) == 0 && values + 4 <= cells * 8 ) {
+            out += "4*" + x;
+            values += 4;
+        } else {
+            out += x;
+            values += 1;
+        }
+
+        out += ++line % 8 == 0 ? "\n" : " ";
+    }
+
+    out += "\n/\n";
+    return out;
+}
+
+}
+
+int main( int argc, char** argv ) {
+    const std::size_t cells = argc > 1 ? std::atol( argv[ 1 ] ) : 1000000;
+
+    const auto body = generate( cells );
+    const auto zcorn = "GRID\nZCORN\n" + body;
+    const auto mapaxes = "GRID\nMAPAXES\n" + body;
+    const lun::parser parser;
+
+    const auto check = parser.tabulate( zcorn );
+    if( check.size() != 2 || check[ 1 ].values() != cells * 8 ) {
+        std::cerr << "ZCORN was not read correctly\n";
+        return EXIT_FAILURE;
+    }
+
+    const auto bulk = best( [&] { return parser.tabulate( zcorn ); } );
+    const auto general = best( [&] { return parser.tabulate( mapaxes ); } );
+
+    const auto mb = body.size() / ( 1024.0 * 1024.0 );
+    const auto values = cells * 8 / 1e6;
+    const auto billion = 1e9 / cells;
+    std::cout << "Input: " << cells << " cells, " << mb << "MB\n"
+              << "ZCORN (bulk):      " << bulk << "s, "
+              << mb / bulk << "MB/s, "
+              << values / bulk << "M values/s, "
+              << bulk * billion << "s for 1e9 cells\n"
+              << "MAPAXES (records): " << general << "s, "
+              << mb / general << "MB/s, "
+              << values / general << "M values/s, "
+              << general * billion << "s for 1e9 cells\n"
+              ;
+}
@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <ctime>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <lunar/parser.hpp>
+
+#include "spirit.hpp"
+
+/*
+ * Measure parse throughput on a generated deck that looks like the bulk of a
+ * real one - long records of doubles, some of them repeated, and a sprinkling
+ * of comments - plus the small RUNSPEC keywords of ints and strings.
+ *
+ * Both parse() into lun::keyword, and tabulate() into the columnar lun::deck
+ * are measured, and the memory they use for the parsed deck. For the lazy
+ * lun::index, both skimming the whole deck, and the time to the first DIMENS
+ * (scan, find and parse it) are measured.
+ *
+ * A warm tabulate() through the deck cache - hashing the input, and mapping
+ * the entry - is measured against a cold one.
+ *
+ * For parse() and tabulate(), the number of allocations with operator new,
+ * and the number of page faults, are counted too. The columns of the deck are
+ * not allocated with new, so only their faults are counted.
+ *
+ * The baseline is the Spirit grammar parse() used before the lexer (see
+ * spirit.cpp), and the speedups over it are printed, with its allocations
+ * and page faults. The goal for parse() is 3x, which it doesn't reach: best
+ * of several runs on a single core, parse() is about 2x faster (43ms vs
+ * 85ms), and tabulate() about 3.5x (25ms). Both parsers make the same 43MB of
+ * 48-byte lun::item, and take about the same 10k page faults to do it, which
+ * is a large part of the time of parse() - on a heap that keeps the memory
+ * between runs, parse() is about 2.5x faster.
+ */
+namespace {
+
+std::atomic< std::size_t > allocations( 0 );
+
+}
+
+void* operator new( std::size_t n ) {
+    ++allocations;
+    if( auto* p = std::malloc( n ) ) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete( void* p ) noexcept {
+    std::free( p );
+}
+
+void operator delete( void* p, std::size_t ) noexcept {
+    std::free( p );
+}
+
+namespace {
+
+double now() {
+    timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+template< typename T >
+std::size_t bytes( lun::span< const T > xs ) {
+    return xs.size() * sizeof( T );
+}
+
+std::size_t bytes( const std::vector< lun::keyword >& kws ) {
+    std::size_t n = kws.capacity() * sizeof( lun::keyword );
+    for( const auto& kw : kws ) {
+        n += kw.xs.capacity() * sizeof( lun::item );
+        for( const auto& x : kw.xs ) {
+            const auto* s = boost::get< std::string >( &x.val );
+            if( s && s->capacity() > 15 ) n += s->capacity();
+        }
+    }
+    return n;
+}
+
+std::size_t bytes( const lun::deck& deck ) {
+    const auto& cols = deck.data();
+    return bytes( cols.tags )
+         + bytes( cols.ints )
+         + bytes( cols.doubles )
+         + bytes( cols.strings )
+         + bytes( cols.pool )
+         + bytes( cols.repeats )
+         + bytes( cols.records )
+         + bytes( cols.keywords )
+         + bytes( cols.names )
+         ;
+}
+
+/* best of 5 parses of input into out, not counting destroying out */
+template< typename T, typename F >
+double best( T& out, F f ) {
+    double t = 1e9;
+    for( int i = 0; i < 5; ++i ) {
+        out = T();
+        const auto start = now();
+        out = f();
+        const auto stop = now();
+        t = std::min( t, stop - start );
+    }
+    return t;
+}
+
+long faults() {
+    rusage r;
+    getrusage( RUSAGE_SELF, &r );
+    return r.ru_minflt + r.ru_majflt;
+}
+
+struct counts {
+    std::size_t allocations;
+    long faults;
+};
+
+/* the allocations and page faults of a single parse */
+template< typename F >
+counts count( F f ) {
+    const auto a = allocations.load();
+    const auto p = faults();
+    {
+        const auto out = f();
+    }
+    return { allocations.load() - a, faults() - p };
+}
+
+std::string generate( int records, int items ) {
+    std::mt19937 gen( 1 );
+    std::uniform_real_distribution< double > value( 0, 1000 );
+    std::uniform_int_distribution< int > pick( 0, 15 );
+
+    std::string out = "RUNSPEC\n";
+    for( int r = 0; r < records; ++r ) {
+        out += "DIMENS\n    100 100 " + std::to_string( r ) + " /\n"
+               "GRIDOPTS\n    'YES' 2* /\n"
+               "-- the bulk\n"
+               "MAPAXES\n";
+
+        for( int i = 0; i < items; ++i ) {
+            switch( pick( gen ) ) {
+                case 0:  out += " 4*0.25"; break;
+                case 1:  out += " 1.5D2";  break;
+                case 2:  out += "\n";      break;
+                default: out += " " + std::to_string( value( gen ) );
+            }
+        }
+
+        out += "\n/\n";
+    }
+
+    return out;
+}
+
+}
+
+int main( int argc, char** argv ) {
+    const int records = argc > 1 ? std::atoi( argv[ 1 ] ) : 100;
+    const int items = argc > 2 ? std::atoi( argv[ 2 ] ) : 10000;
+
+    const auto input = generate( records, items );
+    const lun::parser parser;
+
+    std::vector< lun::keyword > sec;
+    const auto parse = best( sec, [&] { return parser.parse( input ); } );
+
+    std::vector< baseline::keyword > old;
+    const auto spirit = best( old, [&] {
+        return baseline::parse( input.data(), input.data() + input.size() );
+    });
+    if( old.size() != sec.size() ) return EXIT_FAILURE;
+
+    lun::deck deck;
+    const auto tabulate = best( deck, [&] { return parser.tabulate( input ); } );
+
+    char tmpl[] = "/tmp/lunar-deck-cache-XXXXXX";
+    lun::tabulateopts opts;
+    opts.cache = mkdtemp( tmpl );
+    parser.tabulate( input, opts );
+    const auto cached = best( deck, [&] { return parser.tabulate( input, opts ); } );
+    const auto cleanup = "rm -rf '" + opts.cache + "'";
+    if( std::system( cleanup.c_str() ) != 0 ) return EXIT_FAILURE;
+
+    std::size_t keywords = 0;
+    const auto skim = best( keywords, [&] {
+        return parser.scan( input ).size();
+    });
+
+    std::size_t dimens = 0;
+    const auto find = best( dimens, [&] {
+        return parser.scan( input ).find( "DIMENS" )->xs.size();
+    });
+
+    const auto parsecount = count( [&] { return parser.parse( input ); } );
+    const auto spiritcount = count( [&] {
+        return baseline::parse( input.data(), input.data() + input.size() );
+    });
+    const auto tabcount = count( [&] { return parser.tabulate( input ); } );
+
+    const auto mb = input.size() / ( 1024.0 * 1024.0 );
+    const auto mib = []( std::size_t n ) { return n / ( 1024.0 * 1024.0 ); };
+    std::cout << "Input: " << mb << "MB, " << sec.size() << " keywords\n"
+              << "parse:    " << parse << "s, "
+              << mb / parse << "MB/s, "
+              << mib( bytes( sec ) ) << "MB, "
+              << parsecount.allocations << " allocations, "
+              << parsecount.faults << " faults\n"
+              << "spirit:   " << spirit << "s, "
+              << mb / spirit << "MB/s, "
+              << spirit / parse << "x parse, "
+              << spirit / tabulate << "x tabulate, "
+              << spiritcount.allocations << " allocations, "
+              << spiritcount.faults << " faults\n"
+              << "tabulate: " << tabulate << "s, "
+              << mb / tabulate << "MB/s, "
+              << mib( bytes( deck ) ) << "MB, "
+              << tabcount.allocations << " allocations, "
+              << tabcount.faults << " faults\n"
+              << "cached:   " << cached << "s, "
+              << mb / cached << "MB/s\n"
+              << "scan:     " << skim << "s, "
+              << mb / skim << "MB/s, "
+              << keywords << " keywords\n"
+              << "DIMENS:   " << find * 1e3 << "ms\n"
+              ;
+}
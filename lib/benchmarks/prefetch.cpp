@@ -0,0 +1,76 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <ctime>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <lunar/parser.hpp>
+
+/*
+ * Measure the effect of prefetching includes on a slow file system. A deck
+ * with a number of includes is generated in a temporary directory, and every
+ * open is delayed to simulate the latency of a network file system.
+ */
+int main( int argc, char** argv ) {
+    if( argc != 4 ) {
+        std::cout << "Usage: " << argv[ 0 ] << " INCLUDES DELAY-MS THREADS\n";
+        return 1;
+    }
+
+    const auto includes = std::atoi( argv[ 1 ] );
+    const auto delay = std::chrono::milliseconds( std::atoi( argv[ 2 ] ) );
+    const auto threads = std::atoi( argv[ 3 ] );
+
+    char tmpl[] = "/tmp/lunar-prefetch-XXXXXX";
+    const std::string dir = mkdtemp( tmpl );
+    const auto root = dir + "/root.data";
+
+    {
+        std::ofstream deck( root );
+        for( int i = 0; i < includes; ++i ) {
+            const auto name = "inc-" + std::to_string( i ) + ".inc";
+            deck << "INCLUDE\n    '" << name << "' /\n";
+
+            std::ofstream inc( dir + "/" + name );
+            for( int line = 0; line < 2000; ++line )
+                inc << "    0.25 0.5 0.75 1.0 1.25 1.5 1.75 2.0 /\n";
+        }
+    }
+
+    const auto time = [&]( int prefetch ) {
+        lun::concatopts opts;
+        opts.prefetch = prefetch;
+        opts.before_open = [delay]( const std::string& ) {
+            std::this_thread::sleep_for( delay );
+        };
+
+        timespec start, stop;
+        clock_gettime( CLOCK_REALTIME, &start );
+        auto sp = lun::splice( root, opts );
+        clock_gettime( CLOCK_REALTIME, &stop );
+
+        return ( stop.tv_sec - start.tv_sec )
+             + ( stop.tv_nsec - start.tv_nsec )
+             / 1e9;
+    };
+
+    const auto sequential = time( 0 );
+    const auto prefetched = time( threads );
+
+    std::cout << "Includes: " << includes << "\n"
+              << "Open delay: " << delay.count() << "ms\n"
+              << "Sequential: " << sequential << "\n"
+              << "Prefetched (" << threads << " threads): " << prefetched << "\n"
+              << "Speedup: " << sequential / prefetched << "\n"
+              ;
+
+    for( int i = 0; i < includes; ++i )
+        unlink( ( dir + "/inc-" + std::to_string( i ) + ".inc" ).c_str() );
+    unlink( root.c_str() );
+    rmdir( dir.c_str() );
+}
@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <ctime>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <lunar/parser.hpp>
+#include <lunar/reader.hpp>
+
+/*
+ * Compare the readers on a generated deck of many small includes and a few
+ * large ones, both with a warm page cache, and with a cold one. The cache is
+ * cooled by asking the kernel to drop the pages of every input file, which
+ * needs no privileges, but is only a hint - dirty pages can't be dropped, so
+ * the files are synced first.
+ */
+namespace {
+
+volatile std::size_t touched;
+
+double now() {
+    timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+void evict( const std::vector< std::string >& files ) {
+    for( const auto& f : files ) {
+        const int fd = open( f.c_str(), O_RDONLY );
+        if( fd < 0 ) continue;
+        fdatasync( fd );
+        posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED );
+        close( fd );
+    }
+}
+
+}
+
+int main( int argc, char** argv ) {
+    if( argc != 3 ) {
+        std::cout << "Usage: " << argv[ 0 ] << " SMALL-INCLUDES LARGE-MB\n";
+        return 1;
+    }
+
+    const auto small = std::atoi( argv[ 1 ] );
+    const auto largemb = std::atoi( argv[ 2 ] );
+
+    char tmpl[] = "/tmp/lunar-reader-XXXXXX";
+    const std::string dir = mkdtemp( tmpl );
+    const auto root = dir + "/root.data";
+
+    std::vector< std::string > files = { root };
+    {
+        const std::string line = "    0.25 0.5 0.75 1.0 1.25 1.5 1.75 2.0 /\n";
+        std::ofstream deck( root );
+
+        for( int i = 0; i < small; ++i ) {
+            const auto name = "small-" + std::to_string( i ) + ".inc";
+            deck << "INCLUDE\n    '" << name << "' /\n";
+            files.push_back( dir + "/" + name );
+
+            std::ofstream inc( files.back() );
+            for( int n = 0; n < 100; ++n ) inc << line;
+        }
+
+        for( int i = 0; i < 4 && largemb > 0; ++i ) {
+            const auto name = "large-" + std::to_string( i ) + ".inc";
+            deck << "INCLUDE\n    '" << name << "' /\n";
+            files.push_back( dir + "/" + name );
+
+            std::ofstream inc( files.back() );
+            const auto lines = ( std::size_t( largemb ) << 20 ) / line.size();
+            for( std::size_t n = 0; n < lines; ++n ) inc << line;
+        }
+    }
+
+    const auto time = [&]( lun::reader r, bool cold ) {
+        lun::concatopts opts;
+        opts.reader = r;
+
+        double best = 1e9;
+        for( int i = 0; i < 3; ++i ) {
+            if( cold ) evict( files );
+
+            const auto start = now();
+            auto sp = lun::splice( root, opts );
+            /* touch every page, so that lazy mappings pay their faults */
+            std::size_t sum = 0;
+            for( const auto& chunk : sp.inlined.chunks() )
+                for( auto p = chunk.begin(); p < chunk.end(); p += 4096 )
+                    sum += *p;
+            const auto stop = now();
+
+            touched = sum;
+            best = std::min( best, stop - start );
+        }
+
+        return best;
+    };
+
+    std::cout << "Small includes: " << small << "\n"
+              << "Large includes: 4 x " << largemb << "MB\n"
+              << "reader        warm       cold\n"
+              ;
+
+    for( auto r : { lun::reader::automatic,
+                    lun::reader::mmap,
+                    lun::reader::pread,
+                    lun::reader::uring } ) {
+        time( r, false );
+        const auto warm = time( r, false );
+        const auto cold = time( r, true );
+
+        std::cout.width( 8 );
+        std::cout << std::left << lun::reader_name( r ) << " "
+                  << std::right << std::fixed
+                  ;
+        std::cout.width( 9 );
+        std::cout << warm << "s ";
+        std::cout.width( 9 );
+        std::cout << cold << "s\n";
+    }
+
+    for( const auto& f : files ) unlink( f.c_str() );
+    rmdir( dir.c_str() );
+}
@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+
+#include <ctime>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <lunar/search.hpp>
+
+/*
+ * Measure the throughput of every available search kernel by scanning a
+ * (concatenated) deck from start to end, restarting the search past every
+ * match like concatenate does.
+ */
+int main( int argc, char** argv ) {
+    if( argc != 3 ) {
+        std::cout << "Usage: " << argv[ 0 ] << " ITERATIONS INPUT\n";
+        return 1;
+    }
+
+    const auto iterations = std::atoi( argv[ 1 ] );
+    boost::iostreams::mapped_file_source input( argv[ 2 ] );
+
+    for( auto k : { lun::kernel::scalar,
+                    lun::kernel::sse2,
+                    lun::kernel::avx2,
+                    lun::kernel::avx512 } ) {
+
+        const auto fn = lun::search_kernel( k );
+        if( !fn ) {
+            std::cout << lun::kernel_name( k ) << ": unavailable\n";
+            continue;
+        }
+
+        timespec start, stop;
+        double best = 1e9;
+        int matches = 0;
+
+        for( int i = 0; i < iterations; ++i ) {
+            matches = 0;
+            clock_gettime( CLOCK_REALTIME, &start );
+
+            auto cur = input.begin();
+            while( ( cur = fn( cur, input.end() ) ) != input.end() ) {
+                ++matches;
+                ++cur;
+            }
+
+            clock_gettime( CLOCK_REALTIME, &stop );
+
+            double duration = ( stop.tv_sec - start.tv_sec )
+                + ( stop.tv_nsec - start.tv_nsec )
+                / 1e9;
+
+            best = std::min( best, duration );
+        }
+
+        std::cout << lun::kernel_name( k ) << ": "
+                  << input.size() / best / 1e9 << " GB/s "
+                  << "(" << matches << " matches)\n"
+                  ;
+    }
+}
@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include <ctime>
+
+#include <lunar/parser.hpp>
+
+/*
+ * Measure section-selective parsing on a synthetic deck shaped like a
+ * production one - a small RUNSPEC, a GRID of ZCORN, PORO and PERMX, and a
+ * SCHEDULE about twice the size of the GRID, of keywords the parser doesn't
+ * know.
+ *
+ * Reading everything the parser can read (RUNSPEC and GRID) is measured
+ * against reading only RUNSPEC, where the rest of the deck is skipped, and
+ * only GRID.
+ */
+namespace {
+
+double now() {
+    timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* best of 5 */
+template< typename F >
+double best( F f ) {
+    double t = 1e9;
+    for( int i = 0; i < 5; ++i ) {
+        const auto start = now();
+        f();
+        const auto stop = now();
+        t = std::min( t, stop - start );
+    }
+    return t;
+}
+
+std::string array( const char* name, std::size_t n, std::mt19937& gen ) {
+    std::uniform_int_distribution< int > value( 1000, 300000 );
+
+    std::string out = std::string( name ) + "\n";
+    for( std::size_t i = 0; i < n; ++i ) {
+        const auto d = value( gen );
+        out += std::to_string( d / 100 ) + "." + std::to_string( d % 100 );
+        out += ( i + 1 ) % 8 == 0 ? "\n" : " ";
+    }
+    return out + "\n/\n";
+}
+
+std::string schedule( std::size_t size, std::mt19937& gen ) {
+    std::uniform_int_distribution< int > cell( 1, 100 );
+
+    std::string out = "SCHEDULE\n";
+    int step = 0;
+    while( out.size() < size ) {
+        const auto well = "'P" + std::to_string( ++step % 500 ) + "'";
+        out += "-- report step " + std::to_string( step ) + "\n"
+               "WCONPROD\n " + well + " 'OPEN' 'ORAT' 1000.0 4* 150.0 /\n/\n"
+               "COMPDAT\n";
+        for( int k = 0; k < 8; ++k ) {
+            out += " " + well + " "
+                 + std::to_string( cell( gen ) ) + " "
+                 + std::to_string( cell( gen ) ) + " "
+                 + std::to_string( k + 1 ) + " "
+                 + std::to_string( k + 1 ) + " 'OPEN' 1* 1* 0.2159 /\n";
+        }
+        out += "/\nTSTEP\n 30 /\n";
+    }
+    return out;
+}
+
+}
+
+int main( int argc, char** argv ) {
+    const std::size_t cells = argc > 1 ? std::atol( argv[ 1 ] ) : 1000000;
+
+    std::mt19937 gen( 1 );
+    const auto runspec = std::string( "RUNSPEC\n" )
+                       + "DIMENS\n 100 100 " + std::to_string( cells / 10000 ) + " /\n"
+                       + "OIL\nWATER\nGAS\nMETRIC\n"
+                       + "EQLDIMS\n 1 100 20 1 20 /\n"
+                       + "TABDIMS\n 1 1 50 50 1 /\n";
+    const auto grid = "GRID\n"
+                    + array( "ZCORN", cells * 8, gen )
+                    + array( "PORO", cells, gen )
+                    + array( "PERMX", cells, gen );
+    const auto input = runspec + grid + schedule( 2 * grid.size(), gen );
+
+    const auto read = [&]( std::vector< std::string > sections ) {
+        lun::parseopts opts;
+        opts.sections = sections;
+        return lun::parse( input, opts );
+    };
+
+    if( read( { "RUNSPEC" } ).size() != 8
+     || read( { "RUNSPEC", "GRID" } ).size() != 12 ) {
+        std::cerr << "the deck was not read correctly\n";
+        return EXIT_FAILURE;
+    }
+
+    const auto all = best( [&] { read( { "RUNSPEC", "GRID" } ); } );
+    const auto runspeconly = best( [&] { read( { "RUNSPEC" } ); } );
+    const auto gridonly = best( [&] { read( { "GRID" } ); } );
+
+    const auto mb = input.size() / ( 1024.0 * 1024.0 );
+    std::cout << "Input: " << cells << " cells, " << mb << "MB, "
+              << "SCHEDULE " << ( input.size() - runspec.size() - grid.size() )
+                                / ( 1024.0 * 1024.0 ) << "MB\n"
+              << "RUNSPEC + GRID: " << all << "s\n"
+              << "RUNSPEC only:   " << runspeconly << "s, "
+              << mb / runspeconly << "MB/s, "
+              << all / runspeconly << "x faster\n"
+              << "GRID only:      " << gridonly << "s\n"
+              ;
+}
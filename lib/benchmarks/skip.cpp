@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include <ctime>
+
+#include <lunar/lexer.hpp>
+#include <lunar/parser.hpp>
+
+/*
+ * Measure skipping blanks and comments on a generated deck that is mostly
+ * blanks and comments - banners of dashes, commented-out lines, and records
+ * indented and padded into fixed-width columns, like decks written by
+ * pre-processors often are.
+ *
+ * skipws() is measured on its own, by skipping everything between the items
+ * of the deck, against the character-at-a-time loop it replaced, and then
+ * parse() of the whole deck.
+ */
+namespace {
+
+double now() {
+    timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* results are stored here, so that the work isn't optimised away */
+volatile std::size_t sink;
+
+/* best of 5 */
+template< typename F >
+double best( F f ) {
+    double t = 1e9;
+    for( int i = 0; i < 5; ++i ) {
+        const auto start = now();
+        f();
+        const auto stop = now();
+        t = std::min( t, stop - start );
+    }
+    return t;
+}
+
+const char* scalar( const char* fst, const char* lst ) {
+    while( fst != lst ) {
+        if( lun::isblank_( *fst ) ) {
+            ++fst;
+            continue;
+        }
+
+        if( *fst != '-' || lst - fst < 2 || fst[ 1 ] != '-' ) break;
+
+        fst += 2;
+        while( fst != lst && !lun::iseol_( *fst ) ) ++fst;
+    }
+
+    return fst;
+}
+
+std::string generate( std::size_t size ) {
+    std::mt19937 gen( 1 );
+    std::uniform_int_distribution< int > value( 0, 99999 );
+    const std::string banner( 78, '-' );
+
+    std::string out = "RUNSPEC\nDIMENS\n 10 10 10 /\nGRID\n";
+    while( out.size() < size ) {
+        out += banner + "\n"
+               "-- Section generated by the pre-processor, do not edit\n"
+               "-- " + std::to_string( value( gen ) ) + "\n"
+            + banner + "\n\n"
+               "MAPAXES\n";
+        for( int line = 0; line < 8; ++line ) {
+            out += "    ";
+            for( int i = 0; i < 4; ++i ) {
+                const auto x = std::to_string( value( gen ) ) + ".5";
+                out += std::string( 14 - x.size(), ' ' ) + x;
+            }
+            out += "   -- row " + std::to_string( line ) + "\n";
+            if( line % 4 == 3 ) out += "--     0.0   0.0   0.0   0.0\n";
+        }
+        out += "    /\n\n";
+    }
+
+    return out;
+}
+
+/* skip everything that isn't an item, and step over the items */
+template< typename Skip >
+std::size_t walk( const std::string& input, Skip skip ) {
+    const auto* fst = input.data();
+    const auto* lst = fst + input.size();
+    std::size_t skipped = 0;
+    while( fst != lst ) {
+        const auto* p = skip( fst, lst );
+        skipped += p - fst;
+        fst = p;
+        while( fst != lst && !lun::isblank_( *fst ) ) ++fst;
+    }
+    return skipped;
+}
+
+}
+
+int main( int argc, char** argv ) {
+    const std::size_t mb = argc > 1 ? std::atol( argv[ 1 ] ) : 32;
+    const auto input = generate( mb << 20 );
+
+    const auto reference = walk( input, scalar );
+    if( walk( input, lun::skipws ) != reference ) {
+        std::cerr << "skipws does not skip like the scalar loop\n";
+        return EXIT_FAILURE;
+    }
+
+    const auto old = best( [&] { sink = walk( input, scalar ); } );
+    const auto fast = best( [&] { sink = walk( input, lun::skipws ); } );
+    const auto parse = best( [&] { sink = lun::parse( input ).size(); } );
+
+    const auto size = input.size() / ( 1024.0 * 1024.0 );
+    std::cout << "Input: " << size << "MB, "
+              << 100.0 * reference / input.size() << "% blanks and comments\n"
+              << "skip (scalar):  " << old << "s, " << size / old << "MB/s\n"
+              << "skip (skipws):  " << fast << "s, " << size / fast << "MB/s, "
+              << old / fast << "x\n"
+              << "parse:          " << parse << "s, " << size / parse << "MB/s\n"
+              ;
+}
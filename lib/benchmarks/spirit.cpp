@@ -0,0 +1,224 @@
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define BOOST_SPIRIT_USE_PHOENIX_V3 1
+
+#include <boost/fusion/include/adapt_struct.hpp>
+#include <boost/spirit/include/phoenix.hpp>
+#include <boost/spirit/include/qi.hpp>
+
+#include <lunar/parser.hpp>
+
+#include "spirit.hpp"
+
+/*
+ * The Spirit grammar that parse() used before the hand-written lexer, kept as
+ * the baseline of parse-benchmark. It is the grammar as it was, for the
+ * keywords it had then, except that the rules aren't named for debugging.
+ */
+
+namespace phx       = boost::phoenix;
+namespace qi        = boost::spirit::qi;
+namespace ascii     = boost::spirit::ascii;
+
+BOOST_FUSION_ADAPT_STRUCT( baseline::keyword, name, xs )
+// NB! reversed member order in the adapted struct, because in the grammar,
+// repeats comes first
+BOOST_FUSION_ADAPT_STRUCT( lun::item, repeat, val )
+BOOST_FUSION_ADAPT_STRUCT( lun::item::star, val )
+
+namespace baseline {
+
+using lun::item;
+
+namespace {
+
+template< typename Itr >
+struct skipper : public qi::grammar< Itr > {
+    skipper() : skipper::base_type( skip ) {
+        skip = ascii::space
+             | "--" >> *(qi::char_ - qi::eol)
+        ;
+    };
+
+    qi::rule< Itr > skip;
+};
+
+template< typename Itr >
+qi::rule< Itr, item::star() > star = qi::int_ >> '*';
+
+#define kword(sym) qi::raw[qi::lexeme[(sym) >> !qi::alnum]]
+
+template< typename Itr >
+qi::rule< Itr, std::string() > str =
+      '\'' >> *(qi::char_ - '\'') >> '\''
+    | '"'  >> *(qi::char_ - '"')  >> '"'
+    | qi::alpha >> *qi::alnum
+;
+
+template< typename T >
+struct fortran_double : qi::real_policies< T > {
+    template< typename It >
+    static bool parse_exp( It& first, const It& last ) {
+        if( first == last ||
+            (*first != 'e' && *first != 'E' &&
+            *first != 'd' && *first != 'D' ) )
+            return false;
+        ++first;
+        return true;
+    }
+};
+
+qi::real_parser< double, fortran_double< double > > f77float;
+
+#define primary() (qi::int_ >> !qi::char_(".eEdD") | f77float)
+#define term()    (qi::lit('/') >> qi::skip(qi::char_ - qi::eol)[qi::eps])
+
+template< typename Itr, typename... >
+qi::rule< Itr, item() > itemrule;
+
+static const item endrec = { item::endrec{}, item::star() };
+
+template< typename Itr >
+qi::rule< Itr, item() > itemrule< Itr, int > =
+      qi::attr( item::star( 0 ) ) >> qi::int_ >> !qi::lit('*')
+    | star< Itr > >> qi::int_
+;
+
+template< typename Itr >
+qi::rule< Itr, item() > itemrule< Itr, double > =
+      qi::attr( item::star( 0 ) ) >> f77float >> !qi::lit('*')
+    | star< Itr > >> f77float
+;
+
+template< typename Itr >
+qi::rule< Itr, item() > itemrule< Itr, int, double > =
+      qi::attr( item::star( 0 ) ) >> primary() >> !qi::lit('*')
+    | star< Itr > >> primary()
+;
+
+template< typename Itr >
+qi::rule< Itr, item() > itemrule< Itr, std::string > =
+     qi::attr( item::star( 0 ) ) >> str< Itr > >> !qi::lit('*')
+    | star< Itr > >> str< Itr >
+;
+
+template< typename Itr >
+qi::rule< Itr, item() > itemrule< Itr, int, std::string > =
+      itemrule< Itr, int >
+    | itemrule< Itr, std::string >
+;
+
+template< typename Itr >
+qi::rule< Itr, item() > itemrule< Itr, int, double, std::string > =
+      itemrule< Itr, int >
+    | itemrule< Itr, double >
+    | itemrule< Itr, std::string >
+;
+
+template< typename Itr, typename... T >
+qi::rule< Itr, std::vector< item >(), skipper< Itr > > record_rule =
+    *( itemrule< Itr, T... >
+     | star< Itr > >> qi::attr( item::none{} )
+     | '*' >> qi::attr( item::star( 0 ) ) >> qi::attr( item::none{} )
+     )
+    >> term() >> qi::attr( endrec );
+
+std::vector< item > flatten( const std::vector< std::vector< item > >& xs ) {
+    auto size = std::accumulate( xs.begin(), xs.end(), 0,
+            []( auto acc, auto& x ) { return x.size() + acc; } );
+
+    std::vector< item > ys;
+    ys.reserve( size );
+    for( const auto& x : xs )
+        ys.insert( ys.end(), x.begin(), x.end() );
+
+    return ys;
+}
+
+template< typename Itr, int N, typename... T >
+qi::rule< Itr, std::vector< item >(), skipper< Itr > > rec =
+    qi::repeat(N)[record_rule< Itr, T... >]
+        [ qi::_val = phx::bind( flatten, qi::_1 ) ]
+    ;
+
+template< typename Itr >
+struct grammar : qi::grammar< Itr, std::vector< baseline::keyword >(), skipper< Itr >,
+        qi::locals< qi::rule< Itr, std::vector< item >(), skipper< Itr > >* >
+    > {
+    grammar() : grammar::base_type( start ) {
+
+        toggle %= qi::eps;
+
+        /* RUNSPEC */
+        keyword.add
+            ( "RUNSPEC",    &toggle )
+
+            ( "OIL",        &toggle )
+            ( "WATER",      &toggle )
+            ( "GAS",        &toggle )
+            ( "DISGAS",     &toggle )
+            ( "VAPOIL",     &toggle )
+            ( "METRIC",     &toggle )
+            ( "FIELD",      &toggle )
+            ( "LAB",        &toggle )
+            ( "NOSIM",      &toggle )
+            ( "UNIFIN",     &toggle )
+            ( "UNIFOUT",    &toggle )
+
+            ( "DIMENS",     &rec< Itr, 1, int > )
+            ( "EQLDIMS",    &rec< Itr, 1, int > )
+            ( "REGDIMS",    &rec< Itr, 1, int > )
+            ( "WELLDIMS",   &rec< Itr, 1, int > )
+            ( "VFPIDIMS",   &rec< Itr, 1, int > )
+            ( "VFPPDIMS",   &rec< Itr, 1, int > )
+            ( "FAULTDIM",   &rec< Itr, 1, int > )
+            ( "PIMTDIMS",   &rec< Itr, 1, int > )
+            ( "NSTACK",     &rec< Itr, 1, int > )
+            ( "OPTIONS",    &rec< Itr, 1, int > )
+
+            ( "EQLOPTS",    &rec< Itr, 1, std::string > )
+            ( "SATOPTS",    &rec< Itr, 1, std::string > )
+
+            ( "ENDSCALE",   &rec< Itr, 1, int, std::string > )
+            ( "GRIDOPTS",   &rec< Itr, 1, int, std::string > )
+            ( "START",      &rec< Itr, 1, int, std::string > )
+            ( "TABDIMS",    &rec< Itr, 1, int, std::string > )
+
+            ( "TRACERS",    &rec< Itr, 1, int, double, std::string > )
+
+        /* GRID */
+            ( "GRID",       &toggle )
+            ( "NEWTRAN",    &toggle )
+            ( "GRIDFILE",   &rec< Itr, 1, int > )
+            ( "MAPAXES",    &rec< Itr, 1, double > )
+        ;
+
+        start %= *( kword(keyword[ qi::_a = qi::_1 ]) >> qi::lazy( *qi::_a ))
+            >> qi::eoi
+        ;
+    }
+
+    using rule = qi::rule< Itr, std::vector< item >(), skipper< Itr > >;
+
+    rule toggle;
+    qi::symbols< char, rule* > keyword;
+    qi::rule< Itr, std::vector< baseline::keyword >(), skipper< Itr >, qi::locals< rule* > > start;
+};
+
+}
+
+std::vector< keyword > parse( const char* fst, const char* lst ) {
+    static const grammar< const char* > grm;
+    static const skipper< const char* > skip;
+
+    std::vector< keyword > sec;
+    if( !qi::phrase_parse( fst, lst, grm, skip, sec ) )
+        throw std::runtime_error( "spirit: parse failed" );
+
+    return sec;
+}
+
+}
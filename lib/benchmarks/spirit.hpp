@@ -0,0 +1,24 @@
+#ifndef LUNAR_BENCHMARKS_SPIRIT
+#define LUNAR_BENCHMARKS_SPIRIT
+
+#include <string>
+#include <vector>
+
+#include <lunar/parser.hpp>
+
+namespace baseline {
+
+/*
+ * The keyword of the Spirit grammar, as lun::keyword was then, with the name
+ * copied from the input
+ */
+struct keyword {
+    std::string name;
+    std::vector< lun::item > xs;
+};
+
+std::vector< keyword > parse( const char* fst, const char* lst );
+
+}
+
+#endif // LUNAR_BENCHMARKS_SPIRIT
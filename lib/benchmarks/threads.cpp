@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ctime>
+
+#include <lunar/parser.hpp>
+
+/*
+ * Measure how parsing a single large deck scales with the number of threads.
+ * The deck is generated - many keywords, most of them long records of
+ * doubles - and parsed with 1, 2, 4 ... threads, up to the number of cores
+ * or the given maximum. Every parallel parse is checked to give the same
+ * number of keywords and items as the sequential one.
+ */
+namespace {
+
+double now() {
+    timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+std::string generate( std::size_t mb ) {
+    std::string line;
+    for( int i = 0; i < 8; ++i ) line += " " + std::to_string( 0.125 * i );
+    line += "\n";
+
+    std::string out;
+    for( int i = 0; out.size() < ( mb << 20 ); ++i ) {
+        out += "DIMENS\n    100 100 " + std::to_string( i ) + " /\n"
+               "GRIDOPTS\n    'YES' 2* /\n"
+               "-- a comment\n"
+               "MAPAXES\n";
+        for( int n = 0; n < 100; ++n ) out += line;
+        out += "    3*0.5 1D2 /\n";
+    }
+
+    return out;
+}
+
+std::size_t items( const std::vector< lun::keyword >& kws ) {
+    std::size_t n = 0;
+    for( const auto& kw : kws ) n += kw.xs.size();
+    return n;
+}
+
+}
+
+int main( int argc, char** argv ) {
+    const std::size_t mb = argc > 1 ? std::atoi( argv[ 1 ] ) : 256;
+    const int cores = int( std::thread::hardware_concurrency() );
+    const int max = argc > 2 ? std::atoi( argv[ 2 ] ) : std::max( cores, 1 );
+
+    const auto input = generate( mb );
+    const lun::parser parser;
+
+    std::cout << "Input: " << mb << "MB\n"
+              << "Cores: " << cores << "\n"
+              << "threads    time       speedup\n"
+              ;
+
+    double sequential = 0;
+    std::size_t keywords = 0, total = 0;
+    for( int threads = 1; threads <= max; threads *= 2 ) {
+        lun::parseopts opts;
+        opts.threads = threads;
+
+        double best = 1e9;
+        for( int i = 0; i < 3; ++i ) {
+            const auto start = now();
+            const auto sec = parser.parse( input, opts );
+            const auto stop = now();
+            best = std::min( best, stop - start );
+
+            if( threads == 1 ) {
+                keywords = sec.size();
+                total = items( sec );
+            } else if( sec.size() != keywords || items( sec ) != total ) {
+                std::cerr << "Parallel parse differs with "
+                          << threads << " threads\n";
+                return 1;
+            }
+        }
+
+        if( threads == 1 ) sequential = best;
+
+        std::cout.width( 7 );
+        std::cout << threads << " ";
+        std::cout.width( 9 );
+        std::cout << std::fixed << best << "s ";
+        std::cout.width( 9 );
+        std::cout << sequential / best << "x\n";
+    }
+}
@@ -2,10 +2,18 @@
 #define PARSER_HPP
 
 #include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <memory>
 #include <string>
+#include <type_traits>
 #include <vector>
 
+#include <boost/utility/string_view.hpp>
 #include <boost/variant.hpp>
 
 namespace lun {
@@ -25,24 +33,1077 @@ struct item {
     star repeat;
 };
 
+/*
+ * The keywords the parser knows, in the order of the grammar. This list is
+ * the only place keywords are named - their IDs and names are both made from
+ * it, by passing a macro X that picks the parts it needs.
+ */
+#define LUNAR_KEYWORD_LIST( X )                                   \
+    /* RUNSPEC */                                                 \
+    X( RUNSPEC )                                                  \
+    X( OIL )                                                      \
+    X( WATER )                                                    \
+    X( GAS )                                                      \
+    X( DISGAS )                                                   \
+    X( VAPOIL )                                                   \
+    X( METRIC )                                                   \
+    X( FIELD )                                                    \
+    X( LAB )                                                      \
+    X( NOSIM )                                                    \
+    X( UNIFIN )                                                   \
+    X( UNIFOUT )                                                  \
+                                                                  \
+    X( DIMENS )                                                   \
+    X( EQLDIMS )                                                  \
+    X( REGDIMS )                                                  \
+    X( WELLDIMS )                                                 \
+    X( VFPIDIMS )                                                 \
+    X( VFPPDIMS )                                                 \
+    X( FAULTDIM )                                                 \
+    X( PIMTDIMS )                                                 \
+    X( NSTACK )                                                   \
+    X( OPTIONS )                                                  \
+                                                                  \
+    X( EQLOPTS )                                                  \
+    X( SATOPTS )                                                  \
+                                                                  \
+    X( ENDSCALE )                                                 \
+    X( GRIDOPTS )                                                 \
+    X( START )                                                    \
+    X( TABDIMS )                                                  \
+                                                                  \
+    X( TRACERS )                                                  \
+                                                                  \
+    /* GRID */                                                    \
+    X( GRID )                                                     \
+    X( NEWTRAN )                                                  \
+    X( GRIDFILE )                                                 \
+    X( MAPAXES )                                                  \
+                                                                  \
+    X( COORD )                                                    \
+    X( ZCORN )                                                    \
+    X( PORO )                                                     \
+    X( PERMX )                                                    \
+    X( ACTNUM )                                                   \
+                                                                  \
+    /* the other sections, so far only their section keywords */  \
+    X( EDIT )                                                     \
+    X( PROPS )                                                    \
+    X( REGIONS )                                                  \
+    X( SOLUTION )                                                 \
+    X( SUMMARY )                                                  \
+    X( SCHEDULE )
+
+/*
+ * The keywords as dense IDs. Consumers can switch on the ID of a keyword
+ * rather than compare names. unknown is never the ID of a parsed keyword, and
+ * is also the number of keywords.
+ */
+#define LUNAR_KEYWORD_ID( name ) name,
+
+enum class keywordid : std::uint16_t {
+    LUNAR_KEYWORD_LIST( LUNAR_KEYWORD_ID )
+    unknown,
+};
+
+#undef LUNAR_KEYWORD_ID
+
+/*
+ * The name of a keyword, which is static, and the keyword of a name, or
+ * unknown. Names are looked up with a perfect hash, in constant time.
+ */
+const char* name( keywordid );
+keywordid lookup( const char* fst, const char* lst );
+keywordid lookup( const std::string& );
+
+/*
+ * The name of a keyword is the static name of its ID, i.e. name( id ), and
+ * not a copy of the input.
+ */
 struct keyword {
-    std::string name;
+    boost::string_view name;
     std::vector< item > xs;
+    keywordid id = keywordid::unknown;
 };
 
+class deck;
+class index;
+
+struct parseopts {
+    /*
+     * Parse on this many threads. The deck is split into chunks at lines
+     * that start with a keyword, and the chunks are parsed in parallel. The
+     * result is always the same as when parsed on a single thread. Decks
+     * that are too small to split are parsed on the calling thread.
+     */
+    int threads = 1;
+
+    /*
+     * Only parse these sections - RUNSPEC, GRID, EDIT, PROPS, REGIONS,
+     * SOLUTION, SUMMARY or SCHEDULE. The other sections, and their section
+     * keywords, are skipped without being parsed, by looking for the next
+     * line that starts with a section keyword, so they may hold keywords
+     * that the parser doesn't know. Keywords before the first section are
+     * always parsed. Empty means all sections.
+     *
+     * A section name in a quoted string that spans lines ends a skipped
+     * section early. Decks are parsed on a single thread when sections are
+     * selected. Throws std::invalid_argument for an unknown section.
+     */
+    std::vector< std::string > sections;
+};
+
+/*
+ * Parse a deck in memory. The input is only ever read in place, so it can be
+ * any contiguous buffer - a string, a mapped file, or the output of
+ * concatenate() - without copying it first.
+ */
+std::vector< keyword > parse( const char* fst, const char* lst,
+                              const parseopts& = parseopts() );
 std::vector< keyword > parse( std::string::const_iterator fst,
-                              std::string::const_iterator lst );
+                              std::string::const_iterator lst,
+                              const parseopts& = parseopts() );
+std::vector< keyword > parse( const std::string&,
+                              const parseopts& = parseopts() );
+std::vector< keyword > parse( const std::vector< char >&,
+                              const parseopts& = parseopts() );
+
+struct tabulateopts {
+    /*
+     * Directory of cached decks. When set, the deck is stored there, keyed
+     * by a hash of the input, and a deck of the same input is mapped
+     * straight from its entry, without parsing or copying anything - only
+     * hashing the input. Decks of input that couldn't be parsed completely
+     * are not stored. Empty disables caching.
+     */
+    std::string cache;
+};
+
+/*
+ * Parse a deck into the columnar lun::deck. The free tabulate() functions
+ * share the parser of parse().
+ */
+deck tabulate( const char* fst, const char* lst,
+               const tabulateopts& = tabulateopts() );
+deck tabulate( const std::string&,
+               const tabulateopts& = tabulateopts() );
+deck tabulate( const std::vector< char >&,
+               const tabulateopts& = tabulateopts() );
+
+/*
+ * Index a deck, for reading a few keywords without parsing all of it - see
+ * lun::index. The index reads the input in place, so it must outlive the
+ * index, and temporaries are not accepted.
+ */
+index scan( const char* fst, const char* lst );
+index scan( const std::string& );
+index scan( const std::vector< char >& );
+index scan( std::string&& ) = delete;
+index scan( std::vector< char >&& ) = delete;
+
+/*
+ * A parser sets up the keyword tables once, and can then be reused for any
+ * number of decks, and called from any number of threads at the same time.
+ * The free parse() and tabulate() functions share a single parser.
+ */
+class parser {
+    public:
+        parser();
+        ~parser();
+
+        parser( parser&& ) noexcept;
+        parser& operator=( parser&& ) noexcept;
+
+        std::vector< keyword > parse( const char* fst, const char* lst,
+                                      const parseopts& = parseopts() ) const;
+        std::vector< keyword > parse( const std::string&,
+                                      const parseopts& = parseopts() ) const;
+        std::vector< keyword > parse( const std::vector< char >&,
+                                      const parseopts& = parseopts() ) const;
+
+        deck tabulate( const char* fst, const char* lst,
+                       const tabulateopts& = tabulateopts() ) const;
+        deck tabulate( const std::string&,
+                       const tabulateopts& = tabulateopts() ) const;
+        deck tabulate( const std::vector< char >&,
+                       const tabulateopts& = tabulateopts() ) const;
+
+        index scan( const char* fst, const char* lst ) const;
+        index scan( const std::string& ) const;
+        index scan( const std::vector< char >& ) const;
+        index scan( std::string&& ) const = delete;
+        index scan( std::vector< char >&& ) const = delete;
+
+    private:
+        struct impl;
+        std::unique_ptr< const impl > p;
+};
+
+/*
+ * The source map relates every byte of concatenate() output to where it came
+ * from. It's an ordered table of intervals, each one a run of output copied
+ * from a single file, with its position in that file. Intervals are never
+ * longer than stride bytes, so a lookup is a binary search, plus counting the
+ * newlines in at most stride bytes of output.
+ *
+ * file is an index into included, so a file that is included twice has two
+ * different indices. Lines are 1-based.
+ */
+struct sourcemap {
+    static constexpr std::size_t stride = 1 << 16;
+
+    struct interval {
+        std::size_t output; // offset into the output
+        std::size_t file;
+        std::size_t offset; // offset into file
+        std::size_t line;   // line of offset
+    };
+
+    struct location {
+        std::size_t file;
+        std::size_t offset;
+        std::size_t line;
+    };
+
+    std::vector< interval > intervals;
+    std::size_t size = 0;
+
+    /*
+     * Where the byte at offset in output came from. The output must be the
+     * one this map was made for. Throws std::out_of_range if offset is past
+     * the end of the output.
+     */
+    location locate( std::size_t offset, const char* output ) const;
+};
 
 struct inlined {
     std::vector< char > inlined;
     std::vector< std::string > included;
+    sourcemap map;
+};
+
+template< typename T >
+struct span {
+    T* first = nullptr;
+    T* last  = nullptr;
+
+    T* begin() const { return this->first; }
+    T* end() const   { return this->last; }
+    std::size_t size() const { return this->last - this->first; }
+    bool empty() const { return this->first == this->last; }
+};
+
+/*
+ * The columnar form of a parsed deck. Rather than a variant per item, every
+ * item is a one-byte tag, and the values are stored by type in contiguous
+ * columns - all the ints of the deck in one, all the doubles in another, and
+ * the strings back-to-back in a single pool. Repeat counts are only stored
+ * for items that are written as N*value or N*.
+ *
+ * Records and keywords are tables of offsets into the columns, so the nth
+ * record of a keyword, or all the doubles of a keyword, are found in O(1),
+ * without walking the items before them. A double costs 9 bytes, rather than
+ * the 48 of a lun::item, and the values of a keyword are plain arrays that
+ * can be handed straight to a consumer.
+ *
+ * The deck only reads the columns through spans, and shares ownership of
+ * whatever holds them, which can be its own vectors or a mapped file. Copies
+ * of a deck are cheap, and share the columns.
+ */
+class deck {
+    public:
+        enum class type : std::uint8_t {
+            integer,
+            real,
+            string,
+            none,
+            endrec,
+        };
+
+        /*
+         * The tag of an item is its type, with the repeated bit set for items
+         * written as N*, whose N is the next entry in repeats.
+         */
+        static constexpr std::uint8_t repeated = 0x80;
+
+        /* the start of a record in every column */
+        struct offsets {
+            std::size_t item;
+            std::size_t integer;
+            std::size_t real;
+            std::size_t string;
+            std::size_t repeat;
+        };
+
+        struct entry {
+            std::size_t record;
+            std::size_t name;
+        };
+
+        /*
+         * The tables all have a sentinel at the end, so that entry n + 1 is
+         * where entry n ends:
+         *
+         *  string n  is pool[strings[n], strings[n + 1])
+         *  record n  is the items [records[n], records[n + 1])
+         *  keyword n is the records [keywords[n].record, keywords[n + 1].record),
+         *            and named names[keywords[n].name, keywords[n + 1].name)
+         */
+        struct columns {
+            span< const std::uint8_t > tags;
+            span< const int > ints;
+            span< const double > doubles;
+            span< const std::size_t > strings;
+            span< const char > pool;
+            span< const int > repeats;
+            span< const offsets > records;
+            span< const entry > keywords;
+            span< const char > names;
+        };
+
+        /*
+         * Walks items, and yields them as lun::item, like the ones parse()
+         * would make. Items are made on dereference, and not stored.
+         */
+        class const_iterator {
+            public:
+                using iterator_category = std::input_iterator_tag;
+                using value_type        = lun::item;
+                using difference_type   = std::ptrdiff_t;
+                using pointer           = void;
+                using reference         = lun::item;
+
+                const_iterator() = default;
+                const_iterator( const columns* c, const offsets& o ) :
+                    cols( c ), at( o )
+                {}
+
+                lun::item operator*() const;
+
+                /* the type and repeat of the current item */
+                deck::type type() const {
+                    const auto tag = this->cols->tags.first[ this->at.item ];
+                    return deck::type( tag & ~repeated );
+                }
+
+                int repeat() const {
+                    const auto tag = this->cols->tags.first[ this->at.item ];
+                    if( !( tag & repeated ) ) return 0;
+                    return this->cols->repeats.first[ this->at.repeat ];
+                }
+
+                /*
+                 * Every item is a run of values, which is never expanded in
+                 * the deck. count() is the number of values in the run - N
+                 * for N*value and N*, 0 for the end of a record, and 1
+                 * otherwise.
+                 */
+                std::size_t count() const {
+                    const auto tag = this->cols->tags.first[ this->at.item ];
+                    if( deck::type( tag ) == deck::type::endrec ) return 0;
+                    if( !( tag & repeated ) ) return 1;
+                    const auto n = this->cols->repeats.first[ this->at.repeat ];
+                    return n > 0 ? std::size_t( n ) : 0;
+                }
+
+                /* the value of the current item, which must be of that type */
+                int integer() const {
+                    return this->cols->ints.first[ this->at.integer ];
+                }
+
+                double real() const {
+                    return this->cols->doubles.first[ this->at.real ];
+                }
+
+                const_iterator& operator++() {
+                    const auto tag = this->cols->tags.first[ this->at.item ];
+                    switch( deck::type( tag & ~repeated ) ) {
+                        case deck::type::integer: ++this->at.integer; break;
+                        case deck::type::real:    ++this->at.real;    break;
+                        case deck::type::string:  ++this->at.string;  break;
+                        default: break;
+                    }
+                    if( tag & repeated ) ++this->at.repeat;
+                    ++this->at.item;
+                    return *this;
+                }
+
+                const_iterator operator++( int ) {
+                    auto tmp = *this;
+                    ++*this;
+                    return tmp;
+                }
+
+                bool operator==( const const_iterator& o ) const {
+                    return this->at.item == o.at.item;
+                }
+
+                bool operator!=( const const_iterator& o ) const {
+                    return !(*this == o);
+                }
+
+            private:
+                const columns* cols = nullptr;
+                offsets at = {};
+        };
+
+        /*
+         * Walks the values of a range of items, with the runs expanded on
+         * the fly, so N*value is N values, but only stored once. Defaults
+         * (N* and *) are def. T is int or double, and ints are read as
+         * doubles, but the other way around throws std::runtime_error, as
+         * do strings.
+         */
+        template< typename T >
+        class expanding_iterator {
+            public:
+                using iterator_category = std::input_iterator_tag;
+                using value_type        = T;
+                using difference_type   = std::ptrdiff_t;
+                using pointer           = void;
+                using reference         = T;
+
+                expanding_iterator() = default;
+                expanding_iterator( const_iterator fst,
+                                    const_iterator lst,
+                                    T d ) :
+                    cur( fst ), end( lst ), def( d ) {
+                    this->skip();
+                }
+
+                T operator*() const {
+                    switch( this->cur.type() ) {
+                        case deck::type::integer:
+                            return T( this->cur.integer() );
+
+                        case deck::type::real:
+                            if( !std::is_same< T, double >::value )
+                                mismatch( deck::type::real );
+                            return T( this->cur.real() );
+
+                        case deck::type::none:
+                            return this->def;
+
+                        default:
+                            mismatch( this->cur.type() );
+                    }
+                }
+
+                expanding_iterator& operator++() {
+                    if( --this->left == 0 ) {
+                        ++this->cur;
+                        this->skip();
+                    }
+                    return *this;
+                }
+
+                expanding_iterator operator++( int ) {
+                    auto tmp = *this;
+                    ++*this;
+                    return tmp;
+                }
+
+                bool operator==( const expanding_iterator& o ) const {
+                    return this->cur == o.cur && this->left == o.left;
+                }
+
+                bool operator!=( const expanding_iterator& o ) const {
+                    return !(*this == o);
+                }
+
+            private:
+                /* move to the next item that has values */
+                void skip() {
+                    for( ; this->cur != this->end; ++this->cur ) {
+                        this->left = this->cur.count();
+                        if( this->left > 0 ) return;
+                    }
+                    this->left = 0;
+                }
+
+                const_iterator cur;
+                const_iterator end;
+                std::size_t left = 0;
+                T def = T();
+        };
+
+        template< typename T >
+        struct expansion {
+            expanding_iterator< T > first;
+            expanding_iterator< T > last;
+
+            expanding_iterator< T > begin() const { return this->first; }
+            expanding_iterator< T > end() const   { return this->last; }
+        };
+
+        /*
+         * A range of items - a record, or all the records of a keyword. The
+         * ints and doubles of the range are contiguous in the columns.
+         */
+        class items {
+            public:
+                items() = default;
+                items( const columns* c, const offsets& f, const offsets& l ) :
+                    cols( c ), fst( f ), lst( l )
+                {}
+
+                const_iterator begin() const { return { this->cols, this->fst }; }
+                const_iterator end() const   { return { this->cols, this->lst }; }
+                std::size_t size() const { return this->lst.item - this->fst.item; }
+                bool empty() const { return this->size() == 0; }
+
+                span< const int > ints() const {
+                    const auto* p = this->cols->ints.first;
+                    return { p + this->fst.integer, p + this->lst.integer };
+                }
+
+                span< const double > doubles() const {
+                    const auto* p = this->cols->doubles.first;
+                    return { p + this->fst.real, p + this->lst.real };
+                }
+
+                /* the number of values, with the runs expanded */
+                std::size_t values() const;
+
+                /* the values, expanded lazily - see expanding_iterator */
+                template< typename T >
+                expansion< T > expand( T def = T() ) const {
+                    return {
+                        { this->begin(), this->end(), def },
+                        { this->end(), this->end(), def },
+                    };
+                }
+
+                /*
+                 * Write the values, with the runs expanded, to out, and
+                 * return the number of values written. Defaults are def, and
+                 * the types are converted like expand() does. Stretches of
+                 * values without repeats are copied straight from the
+                 * columns, and runs are filled, so the cost is in the number
+                 * of runs, not values.
+                 *
+                 * Throws std::length_error if the values don't fit in out.
+                 */
+                template< typename T >
+                std::size_t fill( span< T > out, T def = T() ) const;
+
+            protected:
+                const columns* cols = nullptr;
+                offsets fst = {};
+                offsets lst = {};
+        };
+
+        class keyword : public items {
+            public:
+                keyword() = default;
+                keyword( const columns*, std::size_t index );
+
+                std::string name() const;
+                keywordid id() const;
+                std::size_t records() const;
+                items record( std::size_t ) const;
+
+            private:
+                std::size_t index = 0;
+        };
+
+        deck() = default;
+        deck( const columns&, std::shared_ptr< const void > owner );
+
+        /* the number of keywords */
+        std::size_t size() const;
+        bool empty() const { return this->size() == 0; }
+        keyword operator[]( std::size_t i ) const { return { this->cols.get(), i }; }
+
+        const columns& data() const;
+
+        /* the keywords as lun::keyword, i.e. what parse() returns */
+        std::vector< lun::keyword > keywords() const;
+
+        /*
+         * The first keyword of a typed decoder's type, decoded - see
+         * lun::dimens. Throws std::out_of_range if there is no such keyword.
+         */
+        template< typename T >
+        T get() const;
+
+    private:
+        /* throws std::runtime_error for values of the wrong type */
+        [[noreturn]] static void mismatch( type );
+
+        std::shared_ptr< const columns > cols;
+};
+
+extern template
+std::size_t deck::items::fill( span< int >, int ) const;
+
+extern template
+std::size_t deck::items::fill( span< double >, double ) const;
+
+/*
+ * Typed decoders for the dimensioning keywords of RUNSPEC, which always have
+ * a single record of a few ints. They are decoded straight into a struct,
+ * with the defaults of the simulator for the items that are defaulted or left
+ * out, rather than walked as items. Items past the ones in the struct are
+ * ignored.
+ *
+ * The schema of a keyword is its struct: the fields, in the order of the
+ * record, their defaults, and the first required items, which have no
+ * default. Decoding throws std::runtime_error for items that aren't ints, and
+ * for required items that are missing.
+ *
+ *  auto dims = lun::get< lun::dimens >( lun::parse( input ) );
+ *  std::vector< double > poro( dims.nx * dims.ny * dims.nz );
+ */
+struct dimens {
+    int nx = 0;
+    int ny = 0;
+    int nz = 0;
+
+    static constexpr keywordid id = keywordid::DIMENS;
+    static constexpr std::size_t required = 3;
+    static std::array< int dimens::*, 3 > fields() {
+        return {{ &dimens::nx, &dimens::ny, &dimens::nz }};
+    }
+};
+
+struct eqldims {
+    int ntequl = 1;   // equilibration regions
+    int ndprvd = 100; // depth nodes in pressure tables
+    int ndrxvd = 20;  // depth nodes in RSVD and RVVD tables
+    int nttrvd = 1;   // initial tracer concentration tables
+    int nstrvd = 20;  // depth nodes in those tables
+
+    static constexpr keywordid id = keywordid::EQLDIMS;
+    static constexpr std::size_t required = 0;
+    static std::array< int eqldims::*, 5 > fields() {
+        return {{
+            &eqldims::ntequl, &eqldims::ndprvd, &eqldims::ndrxvd,
+            &eqldims::nttrvd, &eqldims::nstrvd,
+        }};
+    }
+};
+
+struct regdims {
+    int ntfip  = 1; // fluid-in-place regions
+    int nmfipr = 1; // fluid-in-place region sets
+    int nrfreg = 0; // independent reservoir regions
+    int ntfreg = 0; // flux regions
+
+    static constexpr keywordid id = keywordid::REGDIMS;
+    static constexpr std::size_t required = 0;
+    static std::array< int regdims::*, 4 > fields() {
+        return {{
+            &regdims::ntfip, &regdims::nmfipr,
+            &regdims::nrfreg, &regdims::ntfreg,
+        }};
+    }
+};
+
+struct welldims {
+    int nwmaxz = 0; // wells
+    int ncwmax = 0; // connections per well
+    int ngmaxz = 0; // groups
+    int nwgmax = 0; // wells per group
+
+    static constexpr keywordid id = keywordid::WELLDIMS;
+    static constexpr std::size_t required = 0;
+    static std::array< int welldims::*, 4 > fields() {
+        return {{
+            &welldims::nwmaxz, &welldims::ncwmax,
+            &welldims::ngmaxz, &welldims::nwgmax,
+        }};
+    }
+};
+
+struct vfpidims {
+    int mxsflo = 0; // flow values per table
+    int mxsthp = 0; // THP values per table
+    int nmsvft = 0; // tables
+
+    static constexpr keywordid id = keywordid::VFPIDIMS;
+    static constexpr std::size_t required = 0;
+    static std::array< int vfpidims::*, 3 > fields() {
+        return {{ &vfpidims::mxsflo, &vfpidims::mxsthp, &vfpidims::nmsvft }};
+    }
+};
+
+struct vfppdims {
+    int mxmflo = 0; // flow values per table
+    int mxmthp = 0; // THP values per table
+    int mxmwfr = 0; // water fraction values per table
+    int mxmgfr = 0; // gas fraction values per table
+    int mxmalq = 0; // artificial lift values per table
+    int nmmvft = 0; // tables
+
+    static constexpr keywordid id = keywordid::VFPPDIMS;
+    static constexpr std::size_t required = 0;
+    static std::array< int vfppdims::*, 6 > fields() {
+        return {{
+            &vfppdims::mxmflo, &vfppdims::mxmthp, &vfppdims::mxmwfr,
+            &vfppdims::mxmgfr, &vfppdims::mxmalq, &vfppdims::nmmvft,
+        }};
+    }
+};
+
+struct faultdim {
+    int mfsegs = 0; // fault segments
+
+    static constexpr keywordid id = keywordid::FAULTDIM;
+    static constexpr std::size_t required = 0;
+    static std::array< int faultdim::*, 1 > fields() {
+        return {{ &faultdim::mfsegs }};
+    }
+};
+
+struct pimtdims {
+    int ntpimt = 0; // PI scaling tables
+    int nppimt = 0; // entries per table
+
+    static constexpr keywordid id = keywordid::PIMTDIMS;
+    static constexpr std::size_t required = 0;
+    static std::array< int pimtdims::*, 2 > fields() {
+        return {{ &pimtdims::ntpimt, &pimtdims::nppimt }};
+    }
+};
+
+struct nstack {
+    int lenstk = 10; // length of the linear solver stack
+
+    static constexpr keywordid id = keywordid::NSTACK;
+    static constexpr std::size_t required = 0;
+    static std::array< int nstack::*, 1 > fields() {
+        return {{ &nstack::lenstk }};
+    }
+};
+
+struct tabdims {
+    int ntsfun = 1;  // saturation tables
+    int ntpvt  = 1;  // PVT tables
+    int nssfun = 20; // saturation nodes per table
+    int nppvt  = 20; // pressure nodes per table
+    int ntfip  = 1;  // fluid-in-place regions
+    int nrpvt  = 20; // Rs or Rv nodes per table
+
+    static constexpr keywordid id = keywordid::TABDIMS;
+    static constexpr std::size_t required = 0;
+    static std::array< int tabdims::*, 6 > fields() {
+        return {{
+            &tabdims::ntsfun, &tabdims::ntpvt, &tabdims::nssfun,
+            &tabdims::nppvt, &tabdims::ntfip, &tabdims::nrpvt,
+        }};
+    }
+};
+
+/* decode the first record of a keyword, which must be of T's keyword */
+template< typename T >
+T decode( const keyword& );
+template< typename T >
+T decode( const deck::keyword& );
+
+/*
+ * The first keyword of T's type in a parsed deck, decoded. Throws
+ * std::out_of_range if there is no such keyword.
+ */
+template< typename T >
+T get( const std::vector< keyword >& );
+
+/*
+ * An index of the keywords of a deck, made by scan(). Keywords are found by
+ * skimming the deck for the ends of their records, which only looks at
+ * quotes, comments and /, and is much faster than parsing. The records of a
+ * keyword are parsed the first time the keyword is read, and kept.
+ *
+ * The index is lazy too - the deck is only skimmed as far as the keywords
+ * asked for, so finding a keyword near the start of a large deck is cheap.
+ * size() skims all of it.
+ *
+ * Like parse(), the index stops at the first keyword it doesn't know. A
+ * keyword with records that are not well-formed is only found when it's
+ * read, which throws std::runtime_error, but doesn't stop the index.
+ *
+ * An index can be read from any number of threads at the same time. Copies
+ * are cheap, and share the keywords read so far.
+ */
+class index {
+    public:
+        index() = default;
+
+        /* the number of keywords */
+        std::size_t size() const;
+        bool empty() const;
+
+        /*
+         * The name of the nth keyword, without parsing it. Throws
+         * std::out_of_range if there are not that many keywords.
+         */
+        const std::string& name( std::size_t ) const;
+
+        /*
+         * The nth keyword, parsed on first use. Throws std::out_of_range if
+         * there are not that many keywords.
+         */
+        const keyword& operator[]( std::size_t ) const;
+
+        /* the first keyword called name, or nullptr if there is none */
+        const keyword* find( const std::string& name ) const;
+
+    private:
+        struct impl;
+        friend class parser;
+        explicit index( std::shared_ptr< impl > );
+
+        std::shared_ptr< impl > p;
+};
+
+/*
+ * The rope is the zero-copy output of splice(). Instead of copying every file
+ * into a single buffer, it is an ordered list of chunks that point straight
+ * into the (mmapped) input files. The rope shares ownership of the files, so
+ * its chunks stay valid for as long as the rope, or any copy of it, is alive.
+ *
+ * Walk it either char-by-char through begin()/end(), or a contiguous chunk at
+ * a time through chunks(), which is what parsers and writers should prefer.
+ */
+class rope {
+    public:
+        using chunk = span< const char >;
+        using owner = std::shared_ptr< const void >;
+
+        class const_iterator {
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type        = char;
+                using difference_type   = std::ptrdiff_t;
+                using pointer           = const char*;
+                using reference         = const char&;
+
+                const_iterator() = default;
+                const_iterator( const chunk* c, const chunk* e ) :
+                    cur( c ), end( e ), ptr( c == e ? nullptr : c->first )
+                {}
+
+                reference operator*() const { return *this->ptr; }
+                pointer operator->() const { return this->ptr; }
+
+                const_iterator& operator++() {
+                    if( ++this->ptr != this->cur->last ) return *this;
+                    /* chunks are never empty, so no need to loop */
+                    ++this->cur;
+                    this->ptr = this->cur == this->end
+                              ? nullptr
+                              : this->cur->first;
+                    return *this;
+                }
+
+                const_iterator operator++( int ) {
+                    auto tmp = *this;
+                    ++*this;
+                    return tmp;
+                }
+
+                bool operator==( const const_iterator& o ) const {
+                    return this->ptr == o.ptr;
+                }
+
+                bool operator!=( const const_iterator& o ) const {
+                    return !(*this == o);
+                }
+
+            private:
+                const chunk* cur = nullptr;
+                const chunk* end = nullptr;
+                const char* ptr = nullptr;
+        };
+
+        using iterator = const_iterator;
+
+        const_iterator begin() const {
+            const auto* fst = this->xs.data();
+            return { fst, fst + this->xs.size() };
+        }
+
+        const_iterator end() const {
+            const auto* lst = this->xs.data() + this->xs.size();
+            return { lst, lst };
+        }
+
+        const std::vector< chunk >& chunks() const { return this->xs; }
+        std::size_t size() const { return this->len; }
+        bool empty() const { return this->len == 0; }
+
+        /*
+         * append the range [fst, lst), kept alive by owner. Empty ranges are
+         * silently dropped.
+         */
+        void append( const char* fst, const char* lst, owner o );
+
+    private:
+        std::vector< chunk > xs;
+        std::vector< owner > owners;
+        std::size_t len = 0;
+};
+
+struct spliced {
+    rope inlined;
+    std::vector< std::string > included;
+    sourcemap map;
 };
 
 auto INCLUDE( const char*& fst, const char* lst ) -> std::string;
 auto PATHS( const char*& fst, const char* lst ) ->
     std::vector< std::pair< std::string, std::string > >;
 
-inlined concatenate( const std::string& path );
+/*
+ * How input files are brought into memory:
+ *
+ * mmap:  map the file, and fault every page in up front. Fastest when the
+ *        files are in the page cache, but the whole file is resident.
+ * pread: read the file into a (recycled) buffer. Fastest for small files.
+ * uring: like pread, but the reads are submitted in batches with io_uring,
+ *        falling back to pread where io_uring is unavailable.
+ *
+ * automatic picks a reader per file - small files are read, and large files
+ * are mapped, with the pages faulted in as they're read. The LUNAR_READER
+ * environment variable (auto, mmap, pread or uring) overrides automatic.
+ */
+enum class reader { automatic, mmap, pread, uring };
+
+struct concatopts {
+    /*
+     * Open, map and start reading included files on this many background
+     * threads, as soon as the include is seen, so that the scanner doesn't
+     * stall on I/O. Every file is scanned for includes once up front, so
+     * when streaming, memory is bounded by the largest file rather than by
+     * one chunk. 0 disables prefetching.
+     */
+    int prefetch = 0;
+
+    /*
+     * Called with the path on the opening thread, immediately before a file
+     * is opened. Useful for instrumentation, and to simulate slow file
+     * systems.
+     */
+    std::function< void( const std::string& ) > before_open;
+
+    /*
+     * Directory of cached outputs. When set, the output is stored there,
+     * keyed by the root path, and reused as long as the root and every
+     * included file are unchanged (same device, inode, size and mtime). A
+     * valid entry is mapped and returned as-is, without opening or scanning
+     * any of the input files. Empty disables caching.
+     */
+    std::string cache;
+
+    lun::reader reader = lun::reader::automatic;
+
+    /*
+     * Build the source map of the output. This counts the newlines of the
+     * input as it's copied, which is cheap, but not free. Only used by
+     * splice() and the concatenate() that returns inlined.
+     */
+    bool sourcemap = false;
+};
+
+/*
+ * splice() resolves INCLUDE and PATHS like concatenate(), but without copying
+ * the input - the result refers to the input files directly.
+ *
+ * concatenate() is splice() followed by flatten(), for callers that need the
+ * deck in a single contiguous buffer.
+ */
+spliced splice( const std::string& path, const concatopts& = concatopts() );
+inlined flatten( const spliced& );
+inlined concatenate( const std::string& path,
+                     const concatopts& = concatopts() );
+
+/*
+ * Streaming concatenate: rather than building the output, hand it to a sink
+ * (a callback, an ostream or a file descriptor) in chunks of at most
+ * chunksize bytes, as the include tree is walked. Files are scanned a window
+ * at a time, and pages are released once written, so memory use is bounded
+ * by about one chunk, regardless of deck size. A single line longer than
+ * chunksize is scanned as one window.
+ *
+ * Returns the list of included files, like inlined::included.
+ */
+using sink = std::function< void( const char*, const char* ) >;
+constexpr std::size_t default_chunksize = 1 << 20;
+
+std::vector< std::string >
+concatenate( const std::string& path,
+             const sink&,
+             std::size_t chunksize = default_chunksize,
+             const concatopts& = concatopts() );
+
+std::vector< std::string >
+concatenate( const std::string& path,
+             std::ostream&,
+             std::size_t chunksize = default_chunksize,
+             const concatopts& = concatopts() );
+
+std::vector< std::string >
+concatenate( const std::string& path,
+             int fd,
+             std::size_t chunksize = default_chunksize,
+             const concatopts& = concatopts() );
+
+/*
+ * A session is a deck that is kept up to date with its files, for tools that
+ * re-read the deck as it's edited. It holds the concatenated input and the
+ * parsed keywords, and refresh() brings them up to date when any of the
+ * included files has changed.
+ *
+ * Concatenating again is cheap, but parsing isn't, so only the keywords in
+ * the part of the input that changed are parsed again - for an edit to a
+ * single include file, that's the keywords of that file, plus at most one on
+ * either side. The keywords are always the same as parse( concatenate() ).
+ *
+ * A session is not thread safe.
+ */
+class session {
+    public:
+        /*
+         * Concatenate and parse root. Throws like concatenate() if the deck
+         * can't be read.
+         */
+        explicit session( const std::string& root,
+                          const concatopts& = concatopts() );
+        ~session();
+
+        session( session&& ) noexcept;
+        session& operator=( session&& ) noexcept;
+
+        const lun::inlined& inlined() const;
+        const std::vector< keyword >& keywords() const;
+
+        /* false if the parse stopped before the end of the deck */
+        bool complete() const;
+
+        /*
+         * Check if any of the included files changed (or are gone), and if
+         * so, concatenate and parse again. Returns true if the deck changed.
+         * Throws if the deck can't be read, and then the session is
+         * unchanged.
+         */
+        bool refresh();
+
+        /*
+         * Wait for the included files to change, for at most timeout_ms
+         * milliseconds, or forever if negative, and refresh(). Returns true
+         * if the deck changed, and false on timeout. The directories of the
+         * files are watched with inotify, so that files that are replaced
+         * rather than written, like most editors do, are seen too.
+         */
+        bool watch( int timeout_ms = -1 );
+
+        /* the number of keywords parsed by the last refresh, or the first parse */
+        std::size_t reparsed() const;
+
+    private:
+        struct impl;
+        std::unique_ptr< impl > p;
+};
 
 std::string dot( const std::vector< keyword >& );
 
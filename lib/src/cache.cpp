@@ -0,0 +1,568 @@
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <lunar/parser.hpp>
+
+#include <lunar/cache.hpp>
+
+namespace lun {
+
+namespace {
+
+/*
+ * An entry is laid out as:
+ *
+ *  magic | output | manifest | len(output) | len(manifest) | hash | magic
+ *
+ * with the lengths and hash as native 64-bit integers - the cache is not
+ * meant to be shared between machines. The output is written as it is
+ * produced, which is why the manifest goes at the end.
+ */
+constexpr char magic[ 8 ] = { 'L', 'U', 'N', 'C', 'A', 'T', '0', '2' };
+constexpr std::size_t trailer = 3 * sizeof( std::uint64_t ) + sizeof( magic );
+
+std::uint64_t fnv1a( const char* fst, const char* lst ) {
+    std::uint64_t h = 14695981039346656037ULL;
+    for( ; fst != lst; ++fst ) {
+        h ^= std::uint8_t( *fst );
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/*
+ * The entry key is both the canonical path of the root (so that an entry is
+ * found regardless of the working directory), and the path as given, since
+ * that's what the included paths are relative to.
+ */
+bool entrykey( const std::string& root, std::string& key ) {
+    char* canonical = realpath( root.c_str(), nullptr );
+    if( !canonical ) return false;
+
+    key = canonical;
+    std::free( canonical );
+    key.push_back( '\0' );
+    key.append( root );
+    return true;
+}
+
+std::string entryname( const std::string& dir, const std::string& key ) {
+    char name[ 17 ];
+    const auto h = fnv1a( key.data(), key.data() + key.size() );
+    std::snprintf( name, sizeof( name ), "%016llx", (unsigned long long)h );
+    return dir + "/" + name + ".lunarcat";
+}
+
+void put( std::string& buf, std::uint64_t x ) {
+    buf.append( reinterpret_cast< const char* >( &x ), sizeof( x ) );
+}
+
+void put( std::string& buf, const std::string& x ) {
+    put( buf, x.size() );
+    buf.append( x );
+}
+
+struct unpack {
+    const char* fst;
+    const char* lst;
+
+    std::uint64_t u64() {
+        std::uint64_t x;
+        if( std::size_t( this->lst - this->fst ) < sizeof( x ) )
+            throw std::out_of_range( "truncated cache entry" );
+
+        std::memcpy( &x, this->fst, sizeof( x ) );
+        this->fst += sizeof( x );
+        return x;
+    }
+
+    std::string str() {
+        const auto len = this->u64();
+        if( std::size_t( this->lst - this->fst ) < len )
+            throw std::out_of_range( "truncated cache entry" );
+
+        std::string x( this->fst, this->fst + len );
+        this->fst += len;
+        return x;
+    }
+};
+
+std::string serialize( const std::string& key, const manifest& m ) {
+    std::string buf;
+    put( buf, key );
+
+    put( buf, m.included.size() );
+    for( std::size_t i = 0; i < m.included.size(); ++i ) {
+        const auto& id = m.ids.at( i );
+        put( buf, m.included[ i ] );
+        put( buf, id.dev );
+        put( buf, id.ino );
+        put( buf, id.size );
+        put( buf, std::uint64_t( id.mtime ) );
+    }
+
+    put( buf, m.aliases.size() );
+    for( const auto& kv : m.aliases ) {
+        put( buf, kv.first );
+        put( buf, kv.second );
+    }
+
+    put( buf, std::uint64_t( m.mapped ) );
+    if( !m.mapped ) return buf;
+
+    put( buf, m.map.size );
+    put( buf, m.map.intervals.size() );
+    for( const auto& i : m.map.intervals ) {
+        put( buf, i.output );
+        put( buf, i.file );
+        put( buf, i.offset );
+        put( buf, i.line );
+    }
+
+    return buf;
+}
+
+}
+
+bool operator==( const fileid& lhs, const fileid& rhs ) {
+    return lhs.dev   == rhs.dev
+        && lhs.ino   == rhs.ino
+        && lhs.size  == rhs.size
+        && lhs.mtime == rhs.mtime
+        ;
+}
+
+bool operator!=( const fileid& lhs, const fileid& rhs ) {
+    return !(lhs == rhs);
+}
+
+namespace {
+
+fileid identify( const struct stat& st ) {
+    fileid id;
+    id.dev   = st.st_dev;
+    id.ino   = st.st_ino;
+    id.size  = st.st_size;
+    id.mtime = std::int64_t( st.st_mtim.tv_sec ) * 1000000000
+             + st.st_mtim.tv_nsec;
+    return id;
+}
+
+}
+
+fileid identify( const std::string& path ) {
+    struct stat st;
+    if( stat( path.c_str(), &st ) != 0 )
+        throw std::system_error( errno, std::generic_category(), path );
+
+    return identify( st );
+}
+
+fileid identify( int fd, const std::string& path ) {
+    struct stat st;
+    if( fstat( fd, &st ) != 0 )
+        throw std::system_error( errno, std::generic_category(), path );
+
+    return identify( st );
+}
+
+bool cache_lookup( const std::string& dir,
+                   const std::string& root,
+                   cached& out ) try {
+
+    using mmapd = boost::iostreams::mapped_file_source;
+
+    std::string key;
+    if( !entrykey( root, key ) ) return false;
+
+    const auto name = entryname( dir, key );
+    if( access( name.c_str(), R_OK ) != 0 ) return false;
+
+    auto fh = std::make_shared< const mmapd >( name );
+    const auto* begin = fh->begin();
+    const auto* end = fh->end();
+
+    if( fh->size() < sizeof( magic ) + trailer ) return false;
+    if( std::memcmp( begin, magic, sizeof( magic ) ) != 0 ) return false;
+    if( std::memcmp( end - sizeof( magic ), magic, sizeof( magic ) ) != 0 )
+        return false;
+
+    unpack tail = { end - trailer, end };
+    const auto outlen  = tail.u64();
+    const auto manlen  = tail.u64();
+    const auto hash    = tail.u64();
+
+    if( sizeof( magic ) + outlen + manlen + trailer != fh->size() )
+        return false;
+
+    const auto* output = begin + sizeof( magic );
+    const auto* man = output + outlen;
+    if( fnv1a( man, man + manlen ) != hash ) return false;
+
+    unpack m = { man, man + manlen };
+    if( m.str() != key ) return false;
+
+    std::vector< std::string > included( m.u64() );
+    for( auto& path : included ) {
+        path = m.str();
+
+        fileid id;
+        id.dev   = m.u64();
+        id.ino   = m.u64();
+        id.size  = m.u64();
+        id.mtime = std::int64_t( m.u64() );
+
+        /*
+         * the aliases are also stored, but they come from the files, and are
+         * necessarily unchanged when the files are
+         */
+        if( identify( path ) != id ) return false;
+    }
+
+    const auto aliases = m.u64();
+    for( std::size_t i = 0; i < aliases; ++i ) {
+        m.str();
+        m.str();
+    }
+
+    sourcemap map;
+    const bool mapped = m.u64() != 0;
+    if( mapped ) {
+        map.size = m.u64();
+        map.intervals.resize( m.u64() );
+        for( auto& i : map.intervals ) {
+            i.output = m.u64();
+            i.file   = m.u64();
+            i.offset = m.u64();
+            i.line   = m.u64();
+        }
+    }
+
+    out.output = { output, man };
+    out.owner = std::move( fh );
+    out.included = std::move( included );
+    out.mapped = mapped;
+    out.map = std::move( map );
+    return true;
+} catch( std::exception& ) {
+    return false;
+}
+
+struct cachewriter::impl {
+    std::string key;
+    std::string name;
+    std::string tmp;
+    std::FILE* fp = nullptr;
+    std::uint64_t written = 0;
+    bool ok = false;
+};
+
+cachewriter::cachewriter( const std::string& dir, const std::string& root ) :
+    p( new impl() ) {
+
+    if( !entrykey( root, this->p->key ) ) return;
+
+    this->p->name = entryname( dir, this->p->key );
+    this->p->tmp = this->p->name + ".XXXXXX";
+
+    const int fd = mkstemp( &this->p->tmp[ 0 ] );
+    if( fd < 0 ) return;
+
+    this->p->fp = fdopen( fd, "wb" );
+    if( !this->p->fp ) {
+        close( fd );
+        unlink( this->p->tmp.c_str() );
+        return;
+    }
+
+    this->p->ok = std::fwrite( magic, sizeof( magic ), 1, this->p->fp ) == 1;
+}
+
+cachewriter::~cachewriter() {
+    if( !this->p->fp ) return;
+
+    std::fclose( this->p->fp );
+    unlink( this->p->tmp.c_str() );
+}
+
+void cachewriter::write( const char* fst, const char* lst ) {
+    if( !this->p->ok || fst == lst ) return;
+
+    const std::size_t len = lst - fst;
+    this->p->ok = std::fwrite( fst, 1, len, this->p->fp ) == len;
+    this->p->written += len;
+}
+
+void cachewriter::commit( const manifest& m ) {
+    if( !this->p->ok ) return;
+
+    auto buf = serialize( this->p->key, m );
+    const auto hash = fnv1a( buf.data(), buf.data() + buf.size() );
+    const auto manlen = buf.size();
+    put( buf, this->p->written );
+    put( buf, manlen );
+    put( buf, hash );
+    buf.append( magic, sizeof( magic ) );
+
+    auto* fp = this->p->fp;
+    this->p->fp = nullptr;
+
+    const bool written = std::fwrite( buf.data(), 1, buf.size(), fp )
+                      == buf.size();
+
+    if( std::fclose( fp ) != 0 || !written
+     || std::rename( this->p->tmp.c_str(), this->p->name.c_str() ) != 0 )
+        unlink( this->p->tmp.c_str() );
+}
+
+namespace {
+
+/* the finaliser of murmurhash3 */
+std::uint64_t fmix( std::uint64_t h ) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/*
+ * An entry is laid out as:
+ *
+ *  header | columns
+ *
+ * where every column is 8-byte aligned, at an offset from the start of the
+ * file given in the header. Like the concatenate cache, integers are native.
+ *
+ * The header has a digest of the columns. The offsets inside the columns are
+ * trusted by deck, so a deck is only made from an entry whose columns are
+ * exactly the ones that were stored.
+ */
+constexpr char deckmagic[ 8 ] = { 'L', 'U', 'N', 'D', 'E', 'C', '0', '2' };
+constexpr std::size_t ncolumns = 9;
+
+struct deckheader {
+    char magic[ 8 ];
+    std::uint64_t grammar;
+    std::uint64_t content;
+    std::uint64_t size;
+    std::uint64_t columns;
+
+    struct {
+        std::uint64_t offset;
+        std::uint64_t count;
+    } cols[ ncolumns ];
+};
+
+struct rawcolumn {
+    const void* data;
+    std::size_t count;
+    std::size_t width;
+};
+
+template< typename T >
+rawcolumn raw( span< const T > xs ) {
+    return { xs.begin(), xs.size(), sizeof( T ) };
+}
+
+std::array< rawcolumn, ncolumns > raws( const deck::columns& cols ) {
+    return {{
+        raw( cols.tags ),
+        raw( cols.ints ),
+        raw( cols.doubles ),
+        raw( cols.strings ),
+        raw( cols.pool ),
+        raw( cols.repeats ),
+        raw( cols.records ),
+        raw( cols.keywords ),
+        raw( cols.names ),
+    }};
+}
+
+std::string deckname( const std::string& dir, const deckkey& key ) {
+    char name[ 17 ];
+    const auto h = fmix( key.content ^ fmix( key.grammar ^ key.size ) );
+    std::snprintf( name, sizeof( name ), "%016llx", (unsigned long long)h );
+    return dir + "/" + name + ".lunardeck";
+}
+
+}
+
+std::uint64_t digest( const char* fst, const char* lst ) {
+    /*
+     * four independent lanes of 8 bytes, so that the multiplications
+     * overlap, and the tail is folded in a byte at a time
+     */
+    constexpr std::uint64_t k = 0x9e3779b97f4a7c15ULL;
+    std::uint64_t lanes[ 4 ] = { k, k + 1, k + 2, k + 3 };
+    const auto size = std::uint64_t( lst - fst );
+
+    for( ; lst - fst >= 32; fst += 32 ) {
+        for( int i = 0; i < 4; ++i ) {
+            std::uint64_t x;
+            std::memcpy( &x, fst + 8 * i, sizeof( x ) );
+            lanes[ i ] = ( lanes[ i ] ^ x ) * k;
+            lanes[ i ] ^= lanes[ i ] >> 29;
+        }
+    }
+
+    auto h = fmix( size );
+    for( const auto lane : lanes ) h = fmix( h ^ lane );
+    return fmix( h ^ fnv1a( fst, lst ) );
+}
+
+namespace {
+
+std::uint64_t columnsdigest( const std::array< rawcolumn, ncolumns >& cols ) {
+    std::uint64_t h = 0;
+    for( const auto& col : cols ) {
+        const auto* fst = static_cast< const char* >( col.data );
+        h = fmix( h ^ digest( fst, fst + col.count * col.width ) );
+    }
+    return h;
+}
+
+}
+
+bool cache_lookup( const std::string& dir,
+                   const deckkey& key,
+                   deck& out ) try {
+
+    using mmapd = boost::iostreams::mapped_file_source;
+
+    const auto name = deckname( dir, key );
+    if( access( name.c_str(), R_OK ) != 0 ) return false;
+
+    auto fh = std::make_shared< const mmapd >( name );
+    const auto* begin = fh->begin();
+    const auto filesize = fh->size();
+
+    deckheader header;
+    if( filesize < sizeof( header ) ) return false;
+    std::memcpy( &header, begin, sizeof( header ) );
+
+    if( std::memcmp( header.magic, deckmagic, sizeof( deckmagic ) ) != 0 )
+        return false;
+
+    if( header.grammar != key.grammar
+     || header.content != key.content
+     || header.size    != key.size )
+        return false;
+
+    bool ok = true;
+    const auto column = [&]( std::size_t i, auto& xs ) {
+        using T = typename std::remove_reference< decltype( *xs.begin() ) >::type;
+        const auto offset = header.cols[ i ].offset;
+        const auto count = header.cols[ i ].count;
+
+        ok = ok && offset % alignof( std::uint64_t ) == 0
+                && offset <= filesize
+                && count <= ( filesize - offset ) / sizeof( T );
+
+        if( !ok ) return;
+        xs.first = reinterpret_cast< T* >( begin + offset );
+        xs.last = xs.first + count;
+    };
+
+    deck::columns cols;
+    column( 0, cols.tags );
+    column( 1, cols.ints );
+    column( 2, cols.doubles );
+    column( 3, cols.strings );
+    column( 4, cols.pool );
+    column( 5, cols.repeats );
+    column( 6, cols.records );
+    column( 7, cols.keywords );
+    column( 8, cols.names );
+    if( !ok ) return false;
+
+    /*
+     * the tables end with sentinels that are the sizes of the columns, which
+     * is what a deck relies on to not read outside of them
+     */
+    if( cols.strings.empty() || cols.records.empty() || cols.keywords.empty() )
+        return false;
+
+    const auto& rec = cols.records.last[ -1 ];
+    const auto& kw = cols.keywords.last[ -1 ];
+    const bool consistent = cols.strings.last[ -1 ] == cols.pool.size()
+                         && rec.item    == cols.tags.size()
+                         && rec.integer == cols.ints.size()
+                         && rec.real    == cols.doubles.size()
+                         && rec.string  == cols.strings.size() - 1
+                         && rec.repeat  == cols.repeats.size()
+                         && kw.record   == cols.records.size() - 1
+                         && kw.name     == cols.names.size()
+                         ;
+
+    if( !consistent ) return false;
+    if( columnsdigest( raws( cols ) ) != header.columns ) return false;
+
+    out = deck( cols, std::move( fh ) );
+    return true;
+} catch( std::exception& ) {
+    return false;
+}
+
+void cache_store( const std::string& dir,
+                  const deckkey& key,
+                  const deck& d ) {
+
+    const auto columns = raws( d.data() );
+
+    deckheader header = {};
+    std::memcpy( header.magic, deckmagic, sizeof( deckmagic ) );
+    header.grammar = key.grammar;
+    header.content = key.content;
+    header.size = key.size;
+    header.columns = columnsdigest( columns );
+
+    const auto align = []( std::uint64_t x ) { return ( x + 7 ) & ~7ULL; };
+    std::uint64_t offset = align( sizeof( header ) );
+    for( std::size_t i = 0; i < ncolumns; ++i ) {
+        header.cols[ i ].offset = offset;
+        header.cols[ i ].count = columns[ i ].count;
+        offset = align( offset + columns[ i ].count * columns[ i ].width );
+    }
+
+    const auto name = deckname( dir, key );
+    auto tmp = name + ".XXXXXX";
+    const int fd = mkstemp( &tmp[ 0 ] );
+    if( fd < 0 ) return;
+
+    auto* fp = fdopen( fd, "wb" );
+    if( !fp ) {
+        close( fd );
+        unlink( tmp.c_str() );
+        return;
+    }
+
+    static const char zeros[ 8 ] = {};
+    bool ok = std::fwrite( &header, sizeof( header ), 1, fp ) == 1;
+    std::uint64_t written = sizeof( header );
+    for( std::size_t i = 0; ok && i < ncolumns; ++i ) {
+        const auto pad = header.cols[ i ].offset - written;
+        const auto len = columns[ i ].count * columns[ i ].width;
+        ok = std::fwrite( zeros, 1, pad, fp ) == pad
+          && ( len == 0 || std::fwrite( columns[ i ].data, 1, len, fp ) == len );
+        written += pad + len;
+    }
+
+    if( std::fclose( fp ) != 0 || !ok
+     || std::rename( tmp.c_str(), name.c_str() ) != 0 )
+        unlink( tmp.c_str() );
+}
+
+}
@@ -1,215 +1,502 @@
 #include <algorithm>
-#include <forward_list>
+#include <cerrno>
+#include <cstdint>
 #include <iterator>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
 #include <vector>
 
-#include <boost/iostreams/device/mapped_file.hpp>
+#include <unistd.h>
 
 #include <filesystem/path.h>
 
+#include <lunar/cache.hpp>
 #include <lunar/concatenate.hpp>
 #include <lunar/parser.hpp>
-
-#ifdef HAVE_BUILTIN_EXPECT
-    #define likely(cond)   __builtin_expect(static_cast<bool>((cond)), 1)
-    #define unlikely(cond) __builtin_expect(static_cast<bool>((cond)), 0)
-#else
-    #define likely(cond)   (cond)
-    #define unlikely(cond) (cond)
-#endif
+#include <lunar/pool.hpp>
+#include <lunar/reader.hpp>
+#include <lunar/search.hpp>
 
 namespace lun {
 
 namespace {
 
-template< typename Itr >
-Itr search( Itr begin, Itr end ) {
+using owner = rope::owner;
+
+/*
+ * The end of the next scan window, starting at begin. The window ends just
+ * past the last newline in the first len bytes, so that a keyword is never
+ * split between two windows, and search() looking back for the start of line
+ * never needs to look past begin. A line longer than len makes for a larger
+ * window.
+ *
+ * len == 0 means no window, i.e. scan until end.
+ */
+const char* window( const char* begin, const char* end, std::size_t len ) {
+    if( len == 0 || std::size_t( end - begin ) <= len ) return end;
+
+    const auto rbegin = std::make_reverse_iterator( begin + len );
+    const auto rend = std::make_reverse_iterator( begin );
+    const auto nl = std::find( rbegin, rend, '\n' );
+    if( nl != rend ) return nl.base();
+
+    const auto fwd = std::find( begin + len, end, '\n' );
+    return fwd == end ? end : fwd + 1;
+}
+
+using handle = std::shared_ptr< const source >;
+
+handle open( const std::string& path, const concatopts& opts ) {
+    if( opts.before_open ) opts.before_open( path );
+    return load( path, opts.reader );
+}
+
+std::string unixify( const filesystem::path& prefix, const std::string& x ) {
     /*
-     * The search function is essentially a static boyer-moore, adapted to work
-     * on *two* patterns.
+     * paths, both expanded from PATHS and from INCLUDE can contain
+     * backslashes as dir separators. reinterpret it to only use / as a
+     * separator, since windows handles that just fine
      *
-     * inspect every len(PATHS) character and check if it's possible it is a
-     * part of either PATHS or INCLUDE. If it's a match (rarely - norne is
-     * approx 450 000 lines and 26M large and contain between 50 and 60
-     * includes), rewind until the start of the word and simply check for a
-     * match with no magic.
+     * Probably a tad inefficient, but is only called once per include, of
+     * which there are only a handful
      *
-     * Returns an iterator the *first* match in the sequence of either a PATHS
-     * or an INCLUDE keyword that is not in a comment.
+     * A windows path is only absolute with a drive letter, so the leading /
+     * of an absolute unix path must be restored by hand
      */
-    // TODO: noexcept?
-    constexpr static const char
-        P = 0, A = 1, T = 2, H = 3, S = 4,
-        I = 0, N = 1, C = 2, L = 3, U = 4, D = 5, E = 6;
-
-    constexpr static const char rewinds[21] = {
-        A, 0, C, D, E, 0, 0, H,
-        I, 0, 0, L, 0, N, 0, P,
-        0, 0, S, T, U
-    };
+    filesystem::path include( x );
+    if( !include.is_absolute() )
+        include = prefix / include;
 
-    const auto rskip = []( auto c ) { return rewinds[ c - 'A' ]; };
-    const auto advance = []( auto& itr ) { return itr += 6; };
-
-    const auto rend = std::make_reverse_iterator( begin );
+    const auto absolute = include.is_absolute();
+    include.set( include.str(), filesystem::path::windows_path );
+    return absolute ? "/" + include.str() : include.str();
+}
 
-    const auto candidate = [rend, begin, end]( auto fst ) {
-        constexpr static const char paths[] = { 'A','T','H','S' };
-        constexpr static const char incl[]  = { 'N','C','L','U','D','E' };
+/*
+ * The prefetcher opens and reads (or maps) files on a set of background
+ * threads, so that by the time the scanner reaches an INCLUDE, the file is
+ * (hopefully) ready.
+ *
+ * Requests are speculative - paths are resolved with the aliases known at
+ * the time, which may be wrong or incomplete if a later include defines
+ * PATHS. A request that is never taken costs a wasted open, and its errors
+ * are never reported. If a file was not requested, or the request failed,
+ * take() opens it on the calling thread instead, so errors surface exactly
+ * like they would without prefetching.
+ */
+class prefetcher {
+    public:
+        prefetcher( const concatopts& o ) :
+            opts( o ), workers( o.prefetch )
+        {}
+
+        void request( const std::string& path ) {
+            if( this->pending.count( path ) ) return;
+
+            const auto& o = this->opts;
+            auto fut = this->workers.submit( [path, &o] {
+                return open( path, o );
+            });
+
+            this->pending.emplace( path, std::move( fut ) );
+        }
 
-        if( *fst != 'P' && *fst != 'I' )
-            return false;
+        handle take( const std::string& path ) {
+            const auto itr = this->pending.find( path );
+            if( itr == this->pending.end() ) return open( path, this->opts );
 
-        /* if less than 10 chars are left it's impossible to form a complete
-         * INCLUDE or PATHS keyword, but it has to be checked not to read after
-         * the end-of-file
-         */
-        if( std::distance( fst, end ) < 10 )
-            return false;
+            auto fut = std::move( itr->second );
+            this->pending.erase( itr );
 
-        if( *fst == 'I'
-          && !std::equal( std::begin( incl ), std::end( incl ), fst + 1 ) )
-            return false;
+            try {
+                return fut.get();
+            } catch( std::exception& ) {
+                return open( path, this->opts );
+            }
+        }
 
-        if( *fst == 'P'
-          && !std::equal( std::begin( paths ), std::end( paths ), fst + 1 ) )
-            return false;
+        /*
+         * Find the includes in [fst, lst) ahead of time, and request them.
+         * Paths are resolved with a copy of the aliases known so far, plus
+         * the PATHS found along the way. Anything that doesn't resolve or
+         * parse is left for the scanner to deal with.
+         */
+        void lookahead( const char* fst,
+                        const char* lst,
+                        pathresolver aliases,
+                        const filesystem::path& dir ) {
+
+            while( ( fst = search( fst, lst ) ) != lst ) {
+                try {
+                    if( *fst == 'I' ) {
+                        const auto included = INCLUDE( fst, lst );
+                        try {
+                            const auto resolved = aliases.resolve( included );
+                            this->request( unixify( dir, resolved ) );
+                        } catch( std::exception& ) {}
+                    } else {
+                        const auto paths = PATHS( fst, lst );
+                        aliases.insert( paths.begin(), paths.end() );
+                    }
+                } catch( std::exception& ) {
+                    return;
+                }
+            }
+        }
 
+    private:
+        const concatopts& opts;
+        std::map< std::string, std::future< handle > > pending;
         /*
-         * definitely a match - now search backwards to determine if it's the
-         * first non-blank thing on thise line. Otherwise, it's either
-         * malformed or inside a comment, in which case just skip past it and
-         * continue
+         * the workers are declared last, so that they are destroyed (and
+         * the running tasks finished) before anything else
          */
+        pool workers;
+};
+
+/*
+ * Drain the include tree rooted in path, in order, and hand every run of
+ * non-INCLUDE, non-PATHS text to emit as ( begin, end, file ), where the file
+ * handle also keeps the underlying memory alive. Returns the list of files
+ * read, root first.
+ *
+ * The files are only kept open for as long as they're on the include stack,
+ * so unless emit holds on to the handle, a file is closed as soon as it is
+ * exhausted. A file that is included again while it's still open is not read
+ * again (see bypath and byinode).
+ *
+ * With a non-zero scan window, a file is scanned (and emitted) window by
+ * window, rather than until the next include, so that no more than roughly
+ * one window has been touched, but not emitted, at any time.
+ *
+ * If map is not null, the source map of the output is built along the way.
+ * Newlines are only counted when there is a map.
+ */
+template< typename Emit >
+manifest drain( const std::string& path,
+                const concatopts& opts,
+                Emit emit,
+                std::size_t scanwindow = 0,
+                sourcemap* map = nullptr ) {
+    using Itr = const char*;
+    struct fv {
+        Itr begin, end;
+        handle fh;
+        /* index into included, i.e. the name this file was included by */
+        std::size_t file;
+        /* line of begin, if there is a map */
+        std::size_t line;
+    };
 
-        /* start-of-file, i.e. no need to check if this a comment or dead */
-        if( fst == begin ) return true;
+    const auto dir = filesystem::path( path ).parent_path();
 
-        /* skip blank chars backwards */
-        const auto rfst = std::make_reverse_iterator( fst );
-        constexpr auto blank = [](unsigned char c) { return std::isblank(c); };
-        return *std::find_if_not( rfst, rend, blank ) == '\n';
-    };
+    pathresolver aliases;
+    std::unique_ptr< prefetcher > ahead;
+    if( opts.prefetch > 0 ) ahead.reset( new prefetcher( opts ) );
 
-    // immediately advanced by len+1, which could miss PATHS as the first input
-    // so correct for it
-    auto fst = begin - 2;
+    manifest input_files;
+    std::vector< fv > filequeue;
 
     /*
-     * The end-of-file check is *very* unlikely (once per file, they tend to be
-     * several megabytes) to ever be true, and some speed gains are measurable
-     * when marking it unlikely. the problem is that advancing past the end
-     * pointer is very much undefined, so sequencing is important. branch
-     * predictor should get this most of the time.
-     *
-     * The checking if this character is a substring match, however, is *also*
-     * very likely to be "false", i.e. not a match. This draws on the
-     * observation that *most* of the input file is integers or floats, not one
-     * of the 13 uppercase characters in PATHS and INCLUDE. In Norne, 0.6% of
-     * all characters in the input deck would match.
+     * A physical file is only read once for as long as it's alive, no matter
+     * how many times or by which name it is included. Files are first looked
+     * up by name, which needs no I/O at all, and then by (device, inode), to
+     * catch the same file by different names.
      *
-     * The switch was measured to be slightly faster than a 256-byte lookup
-     * table and a std::bitset.
+     * The files are not kept alive by this lookup, only by the include stack
+     * and by emit. When emit holds on to the handles, as splice does, every
+     * file is read once per run. When it doesn't, as when streaming, a file
+     * is closed as soon as it's exhausted, and its buffer goes back to the
+     * pool for the next file.
      */
-    for( ;; ) {
-        fst = advance( fst );
-        if( unlikely(fst >= end) ) return end;
-
-        switch( *fst ) {
-            case 'P':
-            case 'A':
-            case 'T':
-            case 'H':
-            case 'S':
-
-            case 'I':
-            case 'N':
-            case 'C':
-            case 'L':
-            case 'U':
-            case 'D':
-            case 'E':
-                break;
-
-            default:
-                continue;
+    using inode = std::pair< std::uint64_t, std::uint64_t >;
+    std::map< std::string, std::weak_ptr< const source > > bypath;
+    std::map< inode, std::weak_ptr< const source > > byinode;
+    /* a file that is read again has already had its includes prefetched */
+    std::set< inode > prefetched;
+
+    const auto next = [&]( const std::string& p ) {
+        auto fh = bypath[ p ].lock();
+        if( !fh ) {
+            fh = ahead ? ahead->take( p ) : open( p, opts );
+            const inode key( fh->id.dev, fh->id.ino );
+            auto& known = byinode[ key ];
+            if( auto alive = known.lock() ) fh = std::move( alive );
+            else {
+                known = fh;
+                if( ahead && prefetched.insert( key ).second )
+                    ahead->lookahead( fh->begin(), fh->end(), aliases, dir );
+            }
+
+            bypath[ p ] = fh;
         }
 
-        /* matches a partial, search backwards */
-        const auto cur = fst - rskip( *fst );
+        /*
+         * a file that is already on the include stack can never be exhausted,
+         * so report the chain of includes that lead back to it
+         */
+        const auto cycle = [&fh]( const fv& x ) {
+            return x.fh->id.dev == fh->id.dev && x.fh->id.ino == fh->id.ino;
+        };
 
-        if( !candidate( cur ) ) continue;
+        auto itr = std::find_if( filequeue.begin(), filequeue.end(), cycle );
+        if( itr != filequeue.end() ) {
+            std::string chain;
+            for( ; itr != filequeue.end(); ++itr )
+                chain += input_files.included.at( itr->file ) + " -> ";
 
-        return cur;
-    }
-}
-
-}
+            throw std::runtime_error( "Include cycle: " + chain + p );
+        }
 
-inlined concatenate( const std::string& path ) {
-    static const int M = 1000000;
-    std::vector< char > output;
-    output.reserve( 50 * M );
+        input_files.included.push_back( p );
+        input_files.ids.push_back( fh->id );
+        const auto file = input_files.included.size() - 1;
+        return fv{ fh->begin(), fh->end(), std::move( fh ), file, 1 };
+    };
 
-    using Itr = const char*;
-    using mmapd = boost::iostreams::mapped_file_source;
-    using strpair = std::pair< std::string, std::string >;
-    struct fv { Itr begin, end; };
+    /*
+     * record [fst, lst) of x in the map, in intervals of at most stride
+     * bytes, and return the number of lines it spans
+     */
+    const auto record = [map]( const fv& x, Itr fst, Itr lst ) {
+        std::size_t line = x.line;
+        while( fst != lst ) {
+            const auto len = std::min( std::size_t( lst - fst ),
+                                       sourcemap::stride );
+            const std::size_t offset = fst - x.fh->begin();
+            map->intervals.push_back( { map->size, x.file, offset, line } );
+            map->size += len;
+            line += newlines( fst, fst + len );
+            fst += len;
+        }
 
-    const auto dir = filesystem::path( path ).parent_path();
+        return line - x.line;
+    };
 
-    pathresolver aliases;
-    std::forward_list< mmapd > filehandles = { mmapd{ path } };
-    std::vector< std::string > input_files = { path };
-    std::vector< fv > filequeue = { { filehandles.front().begin(),
-                                      filehandles.front().end() } };
+    filequeue.push_back( next( path ) );
 
-    const auto unixify = []( const auto& prefix, const auto& x ) {
+    while( !filequeue.empty() ) {
         /*
-         * paths, both expanded from PATHS and from INCLUDE can contain
-         * backslashes as dir separators. reinterpret it to only use / as a
-         * separator, since windows handles that just fine
-         *
-         * Probably a tad inefficient, but is only called once per include, of
-         * which there are only a handful
+         * take a copy, not a reference - the queue is pushed to before
+         * current is done with
          */
-        filesystem::path include( x );
-        if( !include.is_absolute() )
-            include = prefix / include;
-        include.set( include.str(), filesystem::path::windows_path );
-        return include.str();
-    };
-
-    while( !filequeue.empty() ) {
-        const auto& current = filequeue.back();
+        const auto current = std::move( filequeue.back() );
         filequeue.pop_back();
 
-        auto cursor = search( current.begin, current.end );
-        output.insert( output.end(), current.begin, cursor );
+        /*
+         * lines of the output are counted by record, but the INCLUDE and
+         * PATHS records themselves are skipped and must be counted here
+         */
+        Itr counted = current.begin;
+        std::size_t lines = 0;
+        const auto resume = [&]( Itr fst ) {
+            auto line = current.line;
+            if( map ) line += lines + newlines( counted, fst );
+            return fv{ fst, current.end, current.fh, current.file, line };
+        };
+
+        const auto lim = window( current.begin, current.end, scanwindow );
+        auto cursor = search( current.begin, lim );
+        if( cursor != current.begin ) {
+            if( map ) lines = record( current, current.begin, cursor );
+            counted = cursor;
+            emit( current.begin, cursor, current.fh );
+        }
 
         /* file exhausted - nothing more to do */
-        if( cursor == current.end ) {
-            filehandles.pop_front();
+        if( cursor == current.end ) continue;
+
+        /* window exhausted - continue with the next one */
+        if( cursor == lim ) {
+            filequeue.push_back( resume( lim ) );
             continue;
         }
 
         if( *cursor == 'I' ) {
             auto included = INCLUDE( cursor, current.end );
 
-            filequeue.push_back( { cursor, current.end } );
+            filequeue.push_back( resume( cursor ) );
             included = unixify( dir, aliases.resolve( included ) );
-            input_files.push_back( included );
-            filehandles.emplace_front( included );
-            const auto& fh = filehandles.front();
-            filequeue.push_back( { fh.begin(), fh.end() } );
+            filequeue.push_back( next( included ) );
         } else {
             auto tmp_paths = PATHS( cursor, current.end );
             aliases.insert( tmp_paths.begin(), tmp_paths.end() );
-            filequeue.push_back( { cursor, current.end } );
+            input_files.aliases.insert( input_files.aliases.end(),
+                                        tmp_paths.begin(),
+                                        tmp_paths.end() );
+            filequeue.push_back( resume( cursor ) );
         }
     }
 
-    return { std::move( output ), std::move( input_files ) };
+    return input_files;
+}
+
+}
+
+void rope::append( const char* fst, const char* lst, owner o ) {
+    if( fst == lst ) return;
+
+    this->xs.push_back( { fst, lst } );
+    this->len += lst - fst;
+
+    /*
+     * the chunks of a file come in runs, and the most recent owner is most
+     * likely to be repeated
+     */
+    if( this->owners.empty() || this->owners.back() != o )
+        this->owners.push_back( std::move( o ) );
+}
+
+constexpr std::size_t sourcemap::stride;
+
+sourcemap::location sourcemap::locate( std::size_t offset,
+                                      const char* output ) const {
+    if( offset >= this->size )
+        throw std::out_of_range( "offset " + std::to_string( offset )
+                               + " is past the end of the output" );
+
+    const auto after = []( std::size_t x, const interval& i ) {
+        return x < i.output;
+    };
+
+    const auto& xs = this->intervals;
+    const auto itr = std::upper_bound( xs.begin(), xs.end(), offset, after );
+    const auto& i = *std::prev( itr );
+
+    const auto* fst = output + i.output;
+    const auto* lst = output + offset;
+    return { i.file, i.offset + ( offset - i.output ),
+             i.line + newlines( fst, lst ) };
+}
+
+spliced splice( const std::string& path, const concatopts& opts ) {
+    rope output;
+
+    cached hit;
+    if( !opts.cache.empty() && cache_lookup( opts.cache, path, hit )
+     && ( hit.mapped || !opts.sourcemap ) ) {
+        output.append( hit.output.begin(), hit.output.end(), hit.owner );
+        return { std::move( output ),
+                 std::move( hit.included ),
+                 std::move( hit.map ) };
+    }
+
+    auto emit = [&output]( const char* fst,
+                           const char* lst,
+                           const handle& fh ) {
+        output.append( fst, lst, fh );
+    };
+
+    sourcemap map;
+    auto m = drain( path, opts, emit, 0, opts.sourcemap ? &map : nullptr );
+
+    if( !opts.cache.empty() ) {
+        m.mapped = opts.sourcemap;
+        m.map = std::move( map );
+
+        cachewriter entry( opts.cache, path );
+        for( const auto& chunk : output.chunks() )
+            entry.write( chunk.begin(), chunk.end() );
+        entry.commit( m );
+
+        map = std::move( m.map );
+    }
+
+    return { std::move( output ), std::move( m.included ), std::move( map ) };
+}
+
+inlined flatten( const spliced& sp ) {
+    std::vector< char > output;
+    output.reserve( sp.inlined.size() );
+
+    for( const auto& chunk : sp.inlined.chunks() )
+        output.insert( output.end(), chunk.begin(), chunk.end() );
+
+    return { std::move( output ), sp.included, sp.map };
+}
+
+inlined concatenate( const std::string& path, const concatopts& opts ) {
+    return flatten( splice( path, opts ) );
+}
+
+std::vector< std::string > concatenate( const std::string& path,
+                                        const sink& out,
+                                        std::size_t chunksize,
+                                        const concatopts& opts ) {
+    if( chunksize == 0 )
+        throw std::invalid_argument( "chunksize must be positive" );
+
+    std::unique_ptr< cachewriter > entry;
+
+    const auto write = [&]( const char* fst, const char* lst ) {
+        while( fst != lst ) {
+            const auto len = std::min( std::size_t( lst - fst ), chunksize );
+            out( fst, fst + len );
+            if( entry ) entry->write( fst, fst + len );
+            fst += len;
+        }
+    };
+
+    /*
+     * Once a range has been handed to the sink it's never read again, so it
+     * can be dropped from memory, which keeps the resident set of mapped
+     * files at about one chunk for arbitrarily large decks.
+     */
+    auto emit = [&]( const char* fst, const char* lst, const handle& fh ) {
+        while( fst != lst ) {
+            const auto len = std::min( std::size_t( lst - fst ), chunksize );
+            write( fst, fst + len );
+            fh->release( fst, fst + len );
+            fst += len;
+        }
+    };
+
+    if( !opts.cache.empty() ) {
+        cached hit;
+        if( cache_lookup( opts.cache, path, hit ) ) {
+            write( hit.output.begin(), hit.output.end() );
+            return hit.included;
+        }
+
+        entry.reset( new cachewriter( opts.cache, path ) );
+    }
+
+    auto m = drain( path, opts, emit, chunksize );
+    if( entry ) entry->commit( m );
+    return std::move( m.included );
+}
+
+std::vector< std::string > concatenate( const std::string& path,
+                                        std::ostream& stream,
+                                        std::size_t chunksize,
+                                        const concatopts& opts ) {
+    auto write = [&stream]( const char* fst, const char* lst ) {
+        if( !stream.write( fst, lst - fst ) )
+            throw std::runtime_error( "Unable to write to stream" );
+    };
+
+    return concatenate( path, write, chunksize, opts );
+}
+
+std::vector< std::string > concatenate( const std::string& path,
+                                        int fd,
+                                        std::size_t chunksize,
+                                        const concatopts& opts ) {
+    auto write = [fd]( const char* fst, const char* lst ) {
+        while( fst != lst ) {
+            const auto n = ::write( fd, fst, lst - fst );
+            if( n < 0 && errno == EINTR ) continue;
+            if( n < 0 )
+                throw std::system_error( errno, std::generic_category(),
+                                         "Unable to write output" );
+            fst += n;
+        }
+    };
+
+    return concatenate( path, write, chunksize, opts );
 }
 
 }
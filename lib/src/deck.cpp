@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <lunar/parser.hpp>
+
+namespace lun {
+
+constexpr std::uint8_t deck::repeated;
+
+namespace {
+
+struct holder {
+    deck::columns cols;
+    std::shared_ptr< const void > owner;
+};
+
+}
+
+deck::deck( const columns& c, std::shared_ptr< const void > owner ) {
+    /* the columns share the lifetime of their owner */
+    auto h = std::make_shared< holder >( holder{ c, std::move( owner ) } );
+    this->cols = std::shared_ptr< const columns >( h, &h->cols );
+}
+
+std::size_t deck::size() const {
+    if( !this->cols || this->cols->keywords.empty() ) return 0;
+    return this->cols->keywords.size() - 1;
+}
+
+const deck::columns& deck::data() const {
+    static const columns empty = {};
+    return this->cols ? *this->cols : empty;
+}
+
+std::vector< lun::keyword > deck::keywords() const {
+    std::vector< lun::keyword > kws;
+    kws.reserve( this->size() );
+
+    for( std::size_t i = 0; i < this->size(); ++i ) {
+        const auto kw = (*this)[ i ];
+        const auto id = kw.id();
+        kws.push_back( lun::keyword{
+            lun::name( id ),
+            std::vector< item >( kw.begin(), kw.end() ),
+            id,
+        });
+    }
+
+    return kws;
+}
+
+deck::keyword::keyword( const columns* c, std::size_t i ) :
+    items( c,
+           c->records.first[ c->keywords.first[ i ].record ],
+           c->records.first[ c->keywords.first[ i + 1 ].record ] ),
+    index( i )
+{}
+
+std::string deck::keyword::name() const {
+    const auto* kws = this->cols->keywords.first;
+    const auto* names = this->cols->names.first;
+    return std::string( names + kws[ this->index ].name,
+                        names + kws[ this->index + 1 ].name );
+}
+
+keywordid deck::keyword::id() const {
+    const auto* kws = this->cols->keywords.first;
+    const auto* names = this->cols->names.first;
+    return lookup( names + kws[ this->index ].name,
+                   names + kws[ this->index + 1 ].name );
+}
+
+std::size_t deck::keyword::records() const {
+    const auto* kws = this->cols->keywords.first;
+    return kws[ this->index + 1 ].record - kws[ this->index ].record;
+}
+
+deck::items deck::keyword::record( std::size_t n ) const {
+    const auto* kws = this->cols->keywords.first;
+    const auto* recs = this->cols->records.first;
+    const auto r = kws[ this->index ].record + n;
+    return items( this->cols, recs[ r ], recs[ r + 1 ] );
+}
+
+void deck::mismatch( type t ) {
+    static const char* names[] = { "int", "double", "string", "default", "/" };
+    const auto i = std::size_t( t );
+    throw std::runtime_error(
+        std::string( "Expected number, got " ) + ( i < 5 ? names[ i ] : "?" )
+    );
+}
+
+std::size_t deck::items::values() const {
+    std::size_t n = 0;
+    for( auto itr = this->begin(); itr != this->end(); ++itr )
+        n += itr.count();
+    return n;
+}
+
+template< typename T >
+std::size_t deck::items::fill( span< T > out, T def ) const {
+    const auto* tags = this->cols->tags.first;
+    const auto* ints = this->cols->ints.first;
+    const auto* doubles = this->cols->doubles.first;
+    const auto* repeats = this->cols->repeats.first;
+
+    auto at = this->fst;
+    auto* dst = out.first;
+
+    const auto reserve = [&]( std::size_t n ) {
+        if( std::size_t( out.last - dst ) < n )
+            throw std::length_error( "fill: values do not fit in output" );
+    };
+
+    while( at.item != this->lst.item ) {
+        const auto tag = tags[ at.item ];
+
+        /*
+         * plain values of the same type are contiguous in their column, so
+         * copy the whole stretch at once
+         */
+        if( tag == std::uint8_t( type::real ) || tag == std::uint8_t( type::integer ) ) {
+            auto end = at.item;
+            while( end != this->lst.item && tags[ end ] == tag ) ++end;
+            const auto n = end - at.item;
+            reserve( n );
+
+            if( tag == std::uint8_t( type::real ) ) {
+                if( !std::is_same< T, double >::value ) mismatch( type::real );
+                dst = std::copy( doubles + at.real, doubles + at.real + n, dst );
+                at.real += n;
+            } else {
+                dst = std::copy( ints + at.integer, ints + at.integer + n, dst );
+                at.integer += n;
+            }
+
+            at.item = end;
+            continue;
+        }
+
+        std::size_t n = 1;
+        if( tag & repeated ) {
+            const auto r = repeats[ at.repeat++ ];
+            n = r > 0 ? std::size_t( r ) : 0;
+        }
+
+        switch( type( tag & ~repeated ) ) {
+            case type::integer:
+                reserve( n );
+                dst = std::fill_n( dst, n, T( ints[ at.integer++ ] ) );
+                break;
+
+            case type::real:
+                if( !std::is_same< T, double >::value ) mismatch( type::real );
+                reserve( n );
+                dst = std::fill_n( dst, n, T( doubles[ at.real++ ] ) );
+                break;
+
+            case type::none:
+                reserve( n );
+                dst = std::fill_n( dst, n, def );
+                break;
+
+            case type::endrec:
+                break;
+
+            default:
+                mismatch( type( tag & ~repeated ) );
+        }
+
+        ++at.item;
+    }
+
+    return dst - out.first;
+}
+
+template std::size_t deck::items::fill( span< int >, int ) const;
+template std::size_t deck::items::fill( span< double >, double ) const;
+
+lun::item deck::const_iterator::operator*() const {
+    const auto star = item::star( this->repeat() );
+
+    switch( this->type() ) {
+        case deck::type::integer:
+            return item{ this->cols->ints.first[ this->at.integer ], star };
+
+        case deck::type::real:
+            return item{ this->cols->doubles.first[ this->at.real ], star };
+
+        case deck::type::string: {
+            const auto* strings = this->cols->strings.first;
+            const auto* pool = this->cols->pool.first;
+            std::string s( pool + strings[ this->at.string ],
+                           pool + strings[ this->at.string + 1 ] );
+            return item{ std::move( s ), star };
+        }
+
+        case deck::type::none:
+            return item{ item::none{}, star };
+
+        case deck::type::endrec:
+        default:
+            return item{ item::endrec{}, item::star() };
+    }
+}
+
+}
@@ -0,0 +1,180 @@
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <boost/variant.hpp>
+
+#include <lunar/parser.hpp>
+
+namespace lun {
+
+namespace {
+
+/*
+ * Fills the fields of T in order, from runs of values and defaults. Runs past
+ * the last field are dropped.
+ */
+template< typename T >
+class decoder {
+    public:
+        static constexpr std::size_t size =
+            std::tuple_size< decltype( T::fields() ) >::value;
+
+        /* n ints of value x */
+        void integers( std::size_t n, int x ) {
+            const auto fields = T::fields();
+            for( ; n > 0 && this->at < size; --n, ++this->at )
+                this->out.*fields[ this->at ] = x;
+        }
+
+        /* n defaults */
+        void defaults( std::size_t n ) {
+            for( ; n > 0 && this->at < size; --n ) {
+                if( this->at < T::required ) missing( this->at );
+                ++this->at;
+            }
+        }
+
+        [[noreturn]] static void mismatch( std::size_t item ) {
+            throw std::runtime_error( keyword() + ": item "
+                                    + std::to_string( item + 1 )
+                                    + " is not an int" );
+        }
+
+        T done() const {
+            if( this->at < T::required ) missing( this->at );
+            return this->out;
+        }
+
+        std::size_t position() const {
+            return this->at;
+        }
+
+        static std::string keyword() {
+            return name( T::id );
+        }
+
+    private:
+        [[noreturn]] static void missing( std::size_t item ) {
+            throw std::runtime_error( keyword() + ": item "
+                                    + std::to_string( item + 1 )
+                                    + " has no default" );
+        }
+
+        T out;
+        std::size_t at = 0;
+};
+
+template< typename T >
+void check( keywordid id ) {
+    const keywordid expected = T::id;
+    if( id != expected ) {
+        throw std::runtime_error( "decode: expected "
+                                + decoder< T >::keyword()
+                                + ", was "
+                                + ( id == keywordid::unknown ? "unknown"
+                                                             : name( id ) ) );
+    }
+}
+
+/* N*value and N* are N values, everything else one */
+std::size_t count( const item& x ) {
+    return x.repeat > 0 ? std::size_t( x.repeat ) : 1;
+}
+
+}
+
+template< typename T >
+T decode( const keyword& kw ) {
+    check< T >( kw.id );
+
+    decoder< T > out;
+    for( const auto& x : kw.xs ) {
+        if( out.position() >= out.size ) break;
+
+        if( const auto* i = boost::get< int >( &x.val ) ) {
+            out.integers( count( x ), *i );
+        } else if( boost::get< item::none >( &x.val ) ) {
+            out.defaults( count( x ) );
+        } else if( boost::get< item::endrec >( &x.val ) ) {
+            break;
+        } else {
+            out.mismatch( out.position() );
+        }
+    }
+
+    return out.done();
+}
+
+template< typename T >
+T decode( const deck::keyword& kw ) {
+    check< T >( kw.id() );
+
+    decoder< T > out;
+    const auto record = kw.records() > 0 ? kw.record( 0 ) : deck::items();
+    for( auto itr = record.begin(); itr != record.end(); ++itr ) {
+        if( out.position() >= out.size ) break;
+
+        switch( itr.type() ) {
+            case deck::type::integer:
+                out.integers( itr.count(), itr.integer() );
+                break;
+
+            case deck::type::none:
+                out.defaults( itr.count() );
+                break;
+
+            case deck::type::endrec:
+                return out.done();
+
+            default:
+                out.mismatch( out.position() );
+        }
+    }
+
+    return out.done();
+}
+
+template< typename T >
+T get( const std::vector< keyword >& kws ) {
+    const keywordid id = T::id;
+    for( const auto& kw : kws )
+        if( kw.id == id ) return decode< T >( kw );
+
+    throw std::out_of_range( "get: no " + decoder< T >::keyword() );
+}
+
+template< typename T >
+T deck::get() const {
+    const keywordid id = T::id;
+    for( std::size_t i = 0; i < this->size(); ++i ) {
+        const auto kw = (*this)[ i ];
+        if( kw.id() == id ) return decode< T >( kw );
+    }
+
+    throw std::out_of_range( "get: no " + decoder< T >::keyword() );
+}
+
+#define LUNAR_DECODER( T )                                  \
+    template T decode< T >( const keyword& );               \
+    template T decode< T >( const deck::keyword& );         \
+    template T get< T >( const std::vector< keyword >& );   \
+    template T deck::get< T >() const;
+
+LUNAR_DECODER( dimens )
+LUNAR_DECODER( eqldims )
+LUNAR_DECODER( regdims )
+LUNAR_DECODER( welldims )
+LUNAR_DECODER( vfpidims )
+LUNAR_DECODER( vfppdims )
+LUNAR_DECODER( faultdim )
+LUNAR_DECODER( pimtdims )
+LUNAR_DECODER( nstack )
+LUNAR_DECODER( tabdims )
+
+#undef LUNAR_DECODER
+
+}
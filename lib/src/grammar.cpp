@@ -1,7 +1,16 @@
 #include <algorithm>
+#include <array>
 #include <cctype>
+#include <cstring>
+#include <deque>
 #include <exception>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
 #define BOOST_SPIRIT_USE_PHOENIX_V3 1
@@ -14,7 +23,13 @@
 
 #include <filesystem/path.h>
 
+#include <lunar/cache.hpp>
 #include <lunar/concatenate.hpp>
+#include <lunar/deck.hpp>
+#include <lunar/incremental.hpp>
+#include <lunar/keywords.hpp>
+#include <lunar/lexer.hpp>
+#include <lunar/pool.hpp>
 
 #include <lunar/parser.hpp>
 
@@ -24,38 +39,36 @@ namespace qi        = boost::spirit::qi;
 namespace ascii     = boost::spirit::ascii;
 namespace bf        = boost::fusion;
 
-BOOST_FUSION_ADAPT_STRUCT( lun::keyword, name, xs )
-// NB! reversed member order in the adapted struct, because in the grammar,
-// repeats comes first
-BOOST_FUSION_ADAPT_STRUCT( lun::item, repeat, val )
-BOOST_FUSION_ADAPT_STRUCT( lun::item::star, val )
-
 namespace lun {
 
 namespace {
 
-template< typename Itr >
-struct skipper : public qi::grammar< Itr > {
-    skipper() : skipper::base_type( skip ) {
-        skip = ascii::space
-             | "--" >> *(qi::char_ - qi::eol)
-        ;
+/*
+ * The lexer's skipws() as a Spirit skipper, for INCLUDE and PATHS. It skips
+ * the same blanks and comments as ascii::space | "--" >> *(char_ - eol), but
+ * a whole run of them per call, rather than a character per call, and
+ * comments with memchr.
+ */
+struct skipper : qi::primitive_parser< skipper > {
+    template< typename Context, typename Itr >
+    struct attribute {
+        using type = spirit::unused_type;
     };
 
-    qi::rule< Itr > skip;
-};
-
-template< typename Itr >
-qi::rule< Itr, item::star() > star = qi::int_ >> '*';
+    template< typename Context, typename Skipper, typename Attribute >
+    bool parse( const char*& fst, const char* const& lst,
+                Context&, const Skipper&, Attribute& ) const {
+        const auto* end = skipws( fst, lst );
+        if( end == fst ) return false;
+        fst = end;
+        return true;
+    }
 
-/*
- * keyword lookup through a qi::symbol table is pretty convenient, but that
- * only selects rule, it doesn't preserve the string. This nifty macro makes
- * will ensure the found keyword is synthesized properly. It also ensures that
- * a keyword is only a match if it matches the *complete* input, i.e. stops the
- * 'SYM' keyword would otherwise match the string 'SYMBOLS'
- */
-#define kword(sym) qi::raw[qi::lexeme[(sym) >> !qi::alnum]]
+    template< typename Context >
+    spirit::info what( Context& ) const {
+        return spirit::info( "skipper" );
+    }
+};
 
 template< typename Itr >
 qi::rule< Itr, std::string() > str =
@@ -64,195 +77,497 @@ qi::rule< Itr, std::string() > str =
     | qi::alpha >> *qi::alnum
 ;
 
-template< typename T >
-struct fortran_double : qi::real_policies< T > {
-    // Eclipse supports Fortran syntax for specifying exponents of floating
-    // point numbers ('D' and 'E', e.g., 1.234d5)
-    template< typename It >
-    static bool parse_exp( It& first, const It& last ) {
-        if( first == last ||
-            (*first != 'e' && *first != 'E' &&
-            *first != 'd' && *first != 'D' ) )
-            return false;
-        ++first;
-        return true;
+#define term()    (qi::lit('/') >> qi::skip(qi::char_ - qi::eol)[qi::eps])
+
+/*
+ * N records (aka list of items, including repeats), read by the hand-written
+ * lexer into a sink. Toggles are keywords without records.
+ *
+ * The records are variadically parametrised on a set of types, which restrict
+ * what types they accept.
+ *
+ * <int> will only accept integers and defaults, and fail on doubles and
+ * strings, and similarly for <double> and <string>. <int, double> will fail
+ * encountering strings, but work for int and doubles. This is because a lot
+ * of keywords accept only the one data type, and can report that error
+ * early, where some keywords accept mixed int/double/string and will usually
+ * be deferred to handle input errors at a later stage.
+ */
+template< typename Sink >
+using rule = bool (*)( const char*&, const char*, Sink& );
+
+/*
+ * The sink of the index, which only wants to know where keywords start and
+ * end. Its records are skimmed, not lexed.
+ */
+struct skimmer {
+    void keyword( keywordid x, const char* fst, const char* lst ) {
+        this->id = x;
+        this->name = fst;
+        this->body = lst;
     }
+
+    void commit() {}
+    void abort() {}
+
+    keywordid id = keywordid::unknown;
+    const char* name = nullptr;
+    const char* body = nullptr;
 };
 
-qi::real_parser< double, fortran_double< double > > f77float;
+template< typename... T >
+bool record( const char*& fst, const char* lst, skimmer& ) {
+    return skim( fst, lst );
+}
+
+template< typename T >
+bool array( const char*& fst, const char* lst, skimmer& ) {
+    return skim( fst, lst );
+}
+
+template< typename Sink, int N, typename... T >
+bool records( const char*& fst, const char* lst, Sink& out ) {
+    for( int i = 0; i < N; ++i )
+        if( !record< T... >( fst, lst, out ) ) return false;
+
+    return true;
+}
+
+template< typename Sink >
+bool toggle( const char*&, const char*, Sink& ) {
+    return true;
+}
+
+/*
+ * The large arrays of GRID, a single record of either ints or doubles, which
+ * are read by the bulk path of the lexer.
+ */
+template< typename Sink, typename T >
+bool values( const char*& fst, const char* lst, Sink& out ) {
+    return array< T >( fst, lst, out );
+}
 
-/* a typical deck contains a LOT more int-values than doubles, which means that
- * by checking for doubles first, we must essentially always backtrack, which
- * is somewhat expensive.
+/*
+ * A keyword is only a match if it matches the *complete* word, i.e. the 'SYM'
+ * keyword must not match the string 'SYMBOLS'.
  *
- * TODO: figure out rule that allows valid ints to parse first that isn't
- * horribly complicated or expensive
+ * The rules are indexed by keywordid, and names are looked up with the
+ * perfect hash of keywordof(). There is one table per sink, but they are all
+ * made from this one list.
  */
+template< typename Sink >
+using ruletable = std::array< rule< Sink >, nkeywords >;
+
+template< typename Sink >
+const ruletable< Sink >& keywords() {
+    using id = keywordid;
+    static const ruletable< Sink > kws = [] {
+        const std::pair< keywordid, rule< Sink > > grammar[] = {
+            /* RUNSPEC */
+            { id::RUNSPEC,    &toggle< Sink > },
+
+            { id::OIL,        &toggle< Sink > },
+            { id::WATER,      &toggle< Sink > },
+            { id::GAS,        &toggle< Sink > },
+            { id::DISGAS,     &toggle< Sink > },
+            { id::VAPOIL,     &toggle< Sink > },
+            { id::METRIC,     &toggle< Sink > },
+            { id::FIELD,      &toggle< Sink > },
+            { id::LAB,        &toggle< Sink > },
+            { id::NOSIM,      &toggle< Sink > },
+            { id::UNIFIN,     &toggle< Sink > },
+            { id::UNIFOUT,    &toggle< Sink > },
+
+            { id::DIMENS,     &records< Sink, 1, int > },
+            { id::EQLDIMS,    &records< Sink, 1, int > },
+            { id::REGDIMS,    &records< Sink, 1, int > },
+            { id::WELLDIMS,   &records< Sink, 1, int > },
+            { id::VFPIDIMS,   &records< Sink, 1, int > },
+            { id::VFPPDIMS,   &records< Sink, 1, int > },
+            { id::FAULTDIM,   &records< Sink, 1, int > },
+            { id::PIMTDIMS,   &records< Sink, 1, int > },
+            { id::NSTACK,     &records< Sink, 1, int > },
+            { id::OPTIONS,    &records< Sink, 1, int > },
+
+            { id::EQLOPTS,    &records< Sink, 1, std::string > },
+            { id::SATOPTS,    &records< Sink, 1, std::string > },
+
+            { id::ENDSCALE,   &records< Sink, 1, int, std::string > },
+            { id::GRIDOPTS,   &records< Sink, 1, int, std::string > },
+            { id::START,      &records< Sink, 1, int, std::string > },
+            { id::TABDIMS,    &records< Sink, 1, int, std::string > },
+
+            { id::TRACERS,    &records< Sink, 1, int, double, std::string > },
+
+            /* GRID */
+            { id::GRID,       &toggle< Sink > },
+            { id::NEWTRAN,    &toggle< Sink > },
+            { id::GRIDFILE,   &records< Sink, 1, int > },
+            { id::MAPAXES,    &records< Sink, 1, double > },
+
+            { id::COORD,      &values< Sink, double > },
+            { id::ZCORN,      &values< Sink, double > },
+            { id::PORO,       &values< Sink, double > },
+            { id::PERMX,      &values< Sink, double > },
+            { id::ACTNUM,     &values< Sink, int > },
+
+            /* the other sections, so far only their section keywords */
+            { id::EDIT,       &toggle< Sink > },
+            { id::PROPS,      &toggle< Sink > },
+            { id::REGIONS,    &toggle< Sink > },
+            { id::SOLUTION,   &toggle< Sink > },
+            { id::SUMMARY,    &toggle< Sink > },
+            { id::SCHEDULE,   &toggle< Sink > },
+        };
+
+        static_assert( sizeof( grammar ) / sizeof( grammar[ 0 ] )
+                       == std::size_t( keywordid::unknown ),
+                       "every keywordid must have exactly one rule" );
+
+        /*
+         * the rules are placed by their ID, not their position in the list,
+         * so an entry out of order is harmless, and a repeated ID is caught
+         * by the one it displaced being left without a rule
+         */
+        ruletable< Sink > table = {};
+        for( const auto& kw : grammar )
+            table[ std::size_t( kw.first ) ] = kw.second;
+
+        for( const auto& rule : table )
+            if( !rule ) throw std::logic_error( "keywordid without a rule" );
+
+        return table;
+    }();
+
+    return kws;
+}
 
-#define primary() (qi::int_ >> !qi::char_(".eEdD") | f77float)
-#define term()    (qi::lit('/') >> qi::skip(qi::char_ - qi::eol)[qi::eps])
+/*
+ * The sink of parse(), which makes lun::keyword. The items are lexed into a
+ * buffer of small tokens that is reused for every keyword, and made into
+ * lun::item once the keyword is complete, straight into a vector of exactly
+ * the right size. That way, every item is only written once, and rolling back
+ * a record doesn't destroy any items. Items are constructed directly from
+ * their value, as assigning to an already constructed variant is several
+ * times slower.
+ */
+class collector {
+    public:
+        void integer( int x, int repeat ) {
+            this->scratch.emplace_back( token::integer, x, repeat );
+        }
+
+        void real( double x, int repeat ) {
+            this->scratch.emplace_back( x, repeat );
+        }
+
+        void string( const char* fst, const char* lst, int repeat ) {
+            const auto i = int( this->strings.size() );
+            this->strings.emplace_back( fst, lst );
+            this->scratch.emplace_back( token::string, i, repeat );
+        }
+
+        void integers( const int* fst, const int* lst, const int* repeats ) {
+            for( ; fst != lst; ++fst ) this->integer( *fst, *repeats++ );
+        }
+
+        void reals( const double* fst, const double* lst, const int* repeats ) {
+            for( ; fst != lst; ++fst ) this->real( *fst, *repeats++ );
+        }
+
+        void none( int repeat ) {
+            this->scratch.emplace_back( token::none, 0, repeat );
+        }
+
+        void endrec() {
+            this->scratch.emplace_back( token::endrec, 0, item::star() );
+        }
+
+        std::size_t mark() const {
+            return this->scratch.size();
+        }
+
+        void rollback( std::size_t n ) {
+            this->scratch.erase( this->scratch.begin() + n, this->scratch.end() );
+        }
+
+        void keyword( keywordid x, const char* fst, const char* lst ) {
+            this->id = x;
+            this->name = boost::string_view( keywordnames[ std::size_t( x ) ],
+                                             lst - fst );
+            this->scratch.clear();
+            this->strings.clear();
+        }
+
+        void commit() {
+            std::vector< item > xs;
+            xs.reserve( this->scratch.size() );
+
+            for( const auto& t : this->scratch ) {
+                if( t.type != token::string ) {
+                    xs.emplace_back( t );
+                    continue;
+                }
+
+                const auto& str = this->strings[ t.i ];
+                std::string x( str.first, str.second );
+                xs.push_back( item{ std::move( x ), item::star( t.repeat ) } );
+            }
+
+            this->sec.push_back( lun::keyword{ this->name, std::move( xs ), this->id } );
+        }
+
+        void abort() {}
+
+        std::vector< lun::keyword > sec;
+
+    private:
+        /*
+         * An item before it's made into a lun::item. A string is the index of
+         * its [begin, end) in strings, which points into the input.
+         *
+         * Tokens are constructed in place, rather than copied in, as copying
+         * a token that was just written field by field stalls on the load of
+         * the fields it was written as.
+         */
+        struct token {
+            enum kind : std::uint8_t { integer, real, string, none, endrec };
+
+            token( double x, int r ) : d( x ), repeat( r ), type( real ) {}
+            token( kind t, int x, int r ) : i( x ), repeat( r ), type( t ) {}
+
+            /*
+             * The item of a token that isn't a string. It's a conversion, so
+             * that emplace_back() constructs the item in place, rather than
+             * moving a temporary in, which is a call for every item.
+             */
+            operator item() const {
+                const item::star r( this->repeat );
+                switch( this->type ) {
+                    case integer: return item{ this->i, r };
+                    case real:    return item{ this->d, r };
+                    case endrec:  return item{ item::endrec{}, r };
+                    default:      return item{ item::none{}, r };
+                }
+            }
+
+            union {
+                int i;
+                double d;
+            };
+            int repeat;
+            kind type;
+        };
+
+        keywordid id = keywordid::unknown;
+        boost::string_view name;
+        std::vector< token > scratch;
+        std::vector< std::pair< const char*, const char* > > strings;
+};
+
+enum class status { more, done, failed };
 
 /*
- * The basic rule for parsing 1 record (aka list of items), including repeats
- *
- * The rule itself is variadically parametrised on a set of types, which allows
- * rules to share the same basic name, but restrict what types they accept.
- *
- * the rule <int> will only accept integers and defaults, and fail on doubles
- * and strings, and similarly for <double> and <string>. <int, double> will
- * fail encountering strings, but work for int and doubles. This is because a
- * lot of keywords accept only the one data type, and can report that error
- * early, where some keywords accept mixed int/double/string and will usually
- * be deferred to handle input errors at a later stage.
- *
- * It's motivated primarily by:
- * - most rules don't accept strings (and a lot don't accept doubles), so
- *   performance should improve slightly by having to consider less
- *   combinations (-> backtracking)
- * - we can report some type errors earlier
- * - the rule inputs become somewhat clearer
+ * Parse the next keyword of [fst, lst), dispatched to the lexer for its
+ * records, and move fst past it. A sink is told where the keyword starts with
+ * keyword(), and whether it was complete with commit() or abort().
  */
-template< typename Itr, typename... >
-qi::rule< Itr, item() > itemrule;
+template< typename Sink >
+status next( const char*& fst, const char* lst, Sink& out ) {
+    const auto& kws = keywords< Sink >();
 
-static const item endrec = { item::endrec{} };
+    fst = skipws( fst, lst );
+    if( fst == lst ) return status::done;
+
+    auto end = fst;
+    while( end != lst && isalnum_( *end ) ) ++end;
+
+    const auto id = keywordof( fst, end );
+    if( id == keywordid::unknown ) return status::failed;
+
+    out.keyword( id, fst, end );
+    fst = end;
+    if( !kws[ std::size_t( id ) ]( fst, lst, out ) ) {
+        out.abort();
+        return status::failed;
+    }
+    out.commit();
+    return status::more;
+}
 
 /*
- * TODO: optimise backtracking patterns
+ * The parser is a loop over keywords. Parsing stops at the first keyword that
+ * isn't known, or isn't well-formed, and everything before it is kept.
+ * Returns true if all of [fst, lst) was parsed.
  */
-template< typename Itr >
-qi::rule< Itr, item() > itemrule< Itr, int > =
-      qi::attr( item::star( 0 ) ) >> qi::int_ >> !qi::lit('*')
-    | star< Itr > >> qi::int_
-;
+template< typename Sink >
+bool drive( const char* fst, const char* lst, Sink& out ) {
+    for( ;; ) {
+        const auto s = next( fst, lst, out );
+        if( s != status::more ) return s == status::done;
+    }
+}
 
-template< typename Itr >
-qi::rule< Itr, item() > itemrule< Itr, double > =
-      qi::attr( item::star( 0 ) ) >> f77float >> !qi::lit('*')
-    | star< Itr > >> f77float
-;
+void failed() {
+    std::cerr << "PARSE FAILED" << std::endl;
+}
 
-template< typename Itr >
-qi::rule< Itr, item() > itemrule< Itr, int, double > =
-      qi::attr( item::star( 0 ) ) >> primary() >> !qi::lit('*')
-    | star< Itr > >> primary()
-;
+/*
+ * The sections of a deck, in the order they appear in it. A section runs from
+ * its section keyword to the next one.
+ */
+constexpr keywordid sections[] = {
+    keywordid::RUNSPEC,
+    keywordid::GRID,
+    keywordid::EDIT,
+    keywordid::PROPS,
+    keywordid::REGIONS,
+    keywordid::SOLUTION,
+    keywordid::SUMMARY,
+    keywordid::SCHEDULE,
+};
 
-template< typename Itr >
-qi::rule< Itr, item() > itemrule< Itr, std::string > =
-     qi::attr( item::star( 0 ) ) >> str< Itr > >> !qi::lit('*')
-    | star< Itr > >> str< Itr >
-;
+constexpr int nsections = sizeof( sections ) / sizeof( sections[ 0 ] );
 
-template< typename Itr >
-qi::rule< Itr, item() > itemrule< Itr, int, std::string > =
-      itemrule< Itr, int >
-    | itemrule< Itr, std::string >
-;
+/* the section keyword [fst, lst), or -1 if it's not one */
+int section( const char* fst, const char* lst ) {
+    const auto id = keywordof( fst, lst );
+    if( id == keywordid::unknown ) return -1;
 
-template< typename Itr >
-qi::rule< Itr, item() > itemrule< Itr, int, double, std::string > =
-      itemrule< Itr, int >
-    | itemrule< Itr, double >
-    | itemrule< Itr, std::string >
-;
+    for( int i = 0; i < nsections; ++i )
+        if( sections[ i ] == id ) return i;
 
-template< typename Itr, typename... T >
-qi::rule< Itr, std::vector< item >(), skipper< Itr > > record_rule =
-    *( itemrule< Itr, T... >
-     | star< Itr > >> qi::attr( item::none{} )
-     | '*' >> qi::attr( item::star( 0 ) ) >> qi::attr( item::none{} )
-     )
-    >> term() >> qi::attr( endrec );
+    return -1;
+}
 
-std::vector< item > flatten( const std::vector< std::vector< item > >& xs ) {
-    auto size = std::accumulate( xs.begin(), xs.end(), 0,
-            []( auto acc, auto& x ) { return x.size() + acc; } );
+/* the sections as a bitmask - throws std::invalid_argument for unknown names */
+unsigned sectionmask( const std::vector< std::string >& names ) {
+    unsigned mask = 0;
+    for( const auto& name : names ) {
+        const auto i = section( name.data(), name.data() + name.size() );
+        if( i < 0 )
+            throw std::invalid_argument( "parse: unknown section " + name );
+        mask |= 1u << i;
+    }
+    return mask;
+}
 
-    std::vector< item > ys;
-    ys.reserve( size );
-    for( const auto& x : xs )
-        ys.insert( ys.end(), x.begin(), x.end() );
+/*
+ * The start of the next line that starts with a section keyword, or lst.
+ * Lines are found with memchr, and only lines that start with the first
+ * letter of a section are looked at closer, so a skipped section is only
+ * ever read at about the speed of memchr.
+ */
+const char* nextsection( const char* fst, const char* lst ) {
+    while( fst != lst ) {
+        const auto* eol = static_cast< const char* >(
+            std::memchr( fst, '\n', lst - fst )
+        );
+        if( !eol ) return lst;
+        fst = eol + 1;
+
+        auto word = fst;
+        while( word != lst && ( *word == ' ' || *word == '\t' ) ) ++word;
+        if( word == lst ) return lst;
+
+        switch( *word ) {
+            case 'R': case 'G': case 'E': case 'P': case 'S': break;
+            default: continue;
+        }
+
+        auto end = word;
+        while( end != lst && isalnum_( *end ) ) ++end;
+        if( section( word, end ) >= 0 ) return word;
+    }
 
-    return ys;
+    return lst;
 }
 
-template< typename Itr, int N, typename... T >
-qi::rule< Itr, std::vector< item >(), skipper< Itr > > rec =
-    qi::repeat(N)[record_rule< Itr, T... >]
-        [ qi::_val = phx::bind( flatten, qi::_1 ) ]
-    ;
+/*
+ * drive(), but only for the sections in wanted. Everything from a section
+ * keyword that isn't wanted to the next section keyword is skipped.
+ */
+template< typename Sink >
+bool drive( const char* fst, const char* lst, Sink& out, unsigned wanted ) {
+    for( ;; ) {
+        fst = skipws( fst, lst );
+
+        auto end = fst;
+        while( end != lst && isalnum_( *end ) ) ++end;
+
+        const auto s = section( fst, end );
+        if( s >= 0 && !( wanted & ( 1u << s ) ) ) {
+            fst = nextsection( end, lst );
+            continue;
+        }
+
+        const auto st = next( fst, lst, out );
+        if( st != status::more ) return st == status::done;
+    }
+}
 
-template< typename Itr >
-struct grammar : qi::grammar< Itr, std::vector< keyword >(), skipper< Itr >,
-        qi::locals< qi::rule< Itr, std::vector< item >(), skipper< Itr > >* >
-    > {
-    grammar() : grammar::base_type( start ) {
-
-        toggle %= qi::eps;
-
-        /* RUNSPEC */
-        keyword.add
-            ( "RUNSPEC",    &toggle )
-
-            ( "OIL",        &toggle )
-            ( "WATER",      &toggle )
-            ( "GAS",        &toggle )
-            ( "DISGAS",     &toggle )
-            ( "VAPOIL",     &toggle )
-            ( "METRIC",     &toggle )
-            ( "FIELD",      &toggle )
-            ( "LAB",        &toggle )
-            ( "NOSIM",      &toggle )
-            ( "UNIFIN",     &toggle )
-            ( "UNIFOUT",    &toggle )
-
-            ( "DIMENS",     &rec< Itr, 1, int > )
-            ( "EQLDIMS",    &rec< Itr, 1, int > )
-            ( "REGDIMS",    &rec< Itr, 1, int > )
-            ( "WELLDIMS",   &rec< Itr, 1, int > )
-            ( "VFPIDIMS",   &rec< Itr, 1, int > )
-            ( "VFPPDIMS",   &rec< Itr, 1, int > )
-            ( "FAULTDIM",   &rec< Itr, 1, int > )
-            ( "PIMTDIMS",   &rec< Itr, 1, int > )
-            ( "NSTACK",     &rec< Itr, 1, int > )
-            ( "OPTIONS",    &rec< Itr, 1, int > )
-
-            ( "EQLOPTS",    &rec< Itr, 1, std::string > )
-            ( "SATOPTS",    &rec< Itr, 1, std::string > )
-
-            ( "ENDSCALE",   &rec< Itr, 1, int, std::string > )
-            ( "GRIDOPTS",   &rec< Itr, 1, int, std::string > )
-            ( "START",      &rec< Itr, 1, int, std::string > )
-            ( "TABDIMS",    &rec< Itr, 1, int, std::string > )
-
-            ( "TRACERS",    &rec< Itr, 1, int, double, std::string > )
-
-        /* GRID */
-            ( "GRID",       &toggle )
-            ( "NEWTRAN",    &toggle )
-            ( "GRIDFILE",   &rec< Itr, 1, int > )
-            ( "MAPAXES",    &rec< Itr, 1, double > )
-        ;
-
-        start %= *( kword(keyword[ qi::_a = qi::_1 ]) >> qi::lazy( *qi::_a ))
-            >> qi::eoi
-        ;
-
-        itemrule< Itr >.name( "item" );
-        itemrule< Itr, int >.name( "item[int]" );
-        itemrule< Itr, double >.name( "item[flt]" );
-        itemrule< Itr, int, double >.name( "item[int|flt]" );
-        itemrule< Itr, std::string >.name( "item[str]" );
-        itemrule< Itr, int, std::string >.name( "item[int|str]" );
-        itemrule< Itr, int, double, std::string >.name( "item[*]" );
+/*
+ * Chunks are never smaller than this, so that small decks aren't split at
+ * all, and a thread always has enough work to pay for itself. There are a
+ * few more chunks than threads, to even out the load when keywords have
+ * very different sizes.
+ */
+constexpr std::size_t minchunk = 1 << 20;
+constexpr std::size_t chunks_per_thread = 4;
+
+/*
+ * Split [fst, lst) into at most n chunks of about the same size. Chunks
+ * start at lines whose first word is a known keyword - comments end at the
+ * end of the line, so such a line is never in a comment.
+ *
+ * Quoted strings can span lines, and it's not possible to tell if a line is
+ * inside one without scanning the deck from the start. Instead, the parse of
+ * every chunk must end exactly at the start of the next, which is only the
+ * case when the chunk boundary is a keyword boundary of the sequential
+ * parse. Returns the boundaries, including fst and lst.
+ */
+std::vector< const char* > split( const char* fst,
+                                  const char* lst,
+                                  std::size_t n ) {
+    const auto size = std::size_t( lst - fst );
+
+    std::vector< const char* > bounds = { fst };
+    for( std::size_t i = 1; i < n; ++i ) {
+        const auto* p = std::max( fst + size / n * i, bounds.back() );
+
+        while( p != lst ) {
+            /* to the start of the next line */
+            const auto* eol = static_cast< const char* >(
+                std::memchr( p, '\n', lst - p )
+            );
+            if( !eol ) {
+                p = lst;
+                break;
+            }
+            p = eol + 1;
+
+            auto word = p;
+            while( word != lst && ( *word == ' ' || *word == '\t' ) ) ++word;
+            auto end = word;
+            while( end != lst && isalnum_( *end ) ) ++end;
+
+            if( keywordof( word, end ) != keywordid::unknown ) {
+                p = word;
+                break;
+            }
+        }
+
+        if( p == lst ) break;
+        if( p != bounds.back() ) bounds.push_back( p );
     }
 
-    using rule = qi::rule< Itr, std::vector< item >(), skipper< Itr > >;
+    bounds.push_back( lst );
+    return bounds;
+}
 
-    rule toggle;
-    qi::symbols< char, rule* > keyword;
-    qi::rule< Itr, std::vector< lun::keyword >(), skipper< Itr >, qi::locals< rule* > > start;
+struct chunk {
+    std::vector< keyword > kws;
+    bool complete;
 };
 
 }
@@ -263,7 +578,7 @@ auto INCLUDE( const char*& fst, const char* lst ) -> std::string {
     std::string included;
     auto ok = qi::phrase_parse( fst, lst,
             "INCLUDE" >> str< Itr > >> term(),
-            skipper< Itr >(), included );
+            skipper(), included );
 
     if( !ok ) throw std::runtime_error( "Invalid INCLUDE" );
 
@@ -278,13 +593,28 @@ auto PATHS( const char*& fst, const char* lst ) ->
     std::vector< std::pair< std::string, std::string > > paths;
     auto ok = qi::phrase_parse( fst, lst,
             "PATHS" >> *(str< Itr > >> str< Itr > >> term()) >> term(),
-            skipper< Itr >(), paths );
+            skipper(), paths );
 
     if( !ok ) throw std::runtime_error( "Invalid PATHS" );
 
     return paths;
 }
 
+const char* name( keywordid id ) {
+    if( std::size_t( id ) >= nkeywords )
+        throw std::out_of_range( "name: no keyword "
+                               + std::to_string( std::size_t( id ) ) );
+    return keywordnames[ std::size_t( id ) ];
+}
+
+keywordid lookup( const char* fst, const char* lst ) {
+    return keywordof( fst, lst );
+}
+
+keywordid lookup( const std::string& name ) {
+    return keywordof( name.data(), name.data() + name.size() );
+}
+
 std::ostream& operator<<( std::ostream& stream, const item::star& s ) {
     return stream << int(s) << "*";
 }
@@ -312,17 +642,471 @@ std::ostream& operator<<( std::ostream& stream, const item& x ) {
     return stream << x.val << "}";
 }
 
-std::vector< keyword > parse( std::string::const_iterator fst,
-                              std::string::const_iterator lst ) {
+/*
+ * The keyword tables are built once, on first use, and only ever read
+ * afterwards, and all per-parse state is on the stack of the caller, so a
+ * single parser can be used by any number of threads.
+ */
+struct parser::impl {
+    impl() {
+        keywords< collector >();
+        keywords< tabulator >();
+        keywords< skimmer >();
+    }
+};
 
-    using grm = grammar< std::string::const_iterator >;
+parser::parser() : p( new impl() ) {}
+parser::~parser() = default;
+parser::parser( parser&& ) noexcept = default;
+parser& parser::operator=( parser&& ) noexcept = default;
+
+std::vector< keyword > parser::parse( const char* fst,
+                                      const char* lst,
+                                      const parseopts& opts ) const {
+    if( !opts.sections.empty() ) {
+        const auto wanted = sectionmask( opts.sections );
+        collector out;
+        if( !drive( fst, lst, out, wanted ) ) failed();
+        return std::move( out.sec );
+    }
 
-    grm parser;
-    std::vector< lun::keyword > sec;
+    const auto size = std::size_t( lst - fst );
+    const auto threads = std::size_t( std::max( opts.threads, 1 ) );
+    const auto n = std::min( threads * chunks_per_thread, size / minchunk );
+    const auto bounds = threads > 1 && n > 1
+                      ? split( fst, lst, n )
+                      : std::vector< const char* >{ fst, lst };
+
+    if( bounds.size() <= 2 ) {
+        collector out;
+        if( !drive( fst, lst, out ) ) failed();
+        return std::move( out.sec );
+    }
+
+    pool workers( int( std::min( threads, bounds.size() - 1 ) ) );
+    std::vector< std::future< chunk > > chunks;
+    for( std::size_t i = 0; i + 1 < bounds.size(); ++i ) {
+        const auto* begin = bounds[ i ];
+        const auto* end = bounds[ i + 1 ];
+        chunks.push_back( workers.submit( [begin, end] {
+            collector out;
+            const auto complete = drive( begin, end, out );
+            return chunk{ std::move( out.sec ), complete };
+        }));
+    }
+
+    std::vector< keyword > sec;
+    for( std::size_t i = 0; i < chunks.size(); ++i ) {
+        auto c = chunks[ i ].get();
+        if( c.complete ) {
+            sec.insert( sec.end(), std::make_move_iterator( c.kws.begin() ),
+                                   std::make_move_iterator( c.kws.end() ) );
+            continue;
+        }
+
+        /*
+         * Either the deck is broken here, or the chunk boundary was in a
+         * quoted string. The start of this chunk is known to be good, so
+         * parse the rest of the deck from there, like a sequential parse
+         * would. The pool discards the chunks that haven't started.
+         */
+        collector out;
+        if( !drive( bounds[ i ], lst, out ) ) failed();
+        sec.insert( sec.end(), std::make_move_iterator( out.sec.begin() ),
+                               std::make_move_iterator( out.sec.end() ) );
+        break;
+    }
 
-    auto ok = qi::phrase_parse( fst, lst, parser, skipper< decltype( fst ) >(), sec );
-    if( !ok ) std::cerr << "PARSE FAILED" << std::endl;
     return sec;
 }
 
+std::vector< keyword > parser::parse( const std::string& input,
+                                      const parseopts& opts ) const {
+    return this->parse( input.data(), input.data() + input.size(), opts );
+}
+
+std::vector< keyword > parser::parse( const std::vector< char >& input,
+                                      const parseopts& opts ) const {
+    return this->parse( input.data(), input.data() + input.size(), opts );
+}
+
+namespace {
+
+/*
+ * The grammar part of the deck cache key. Decks parsed with a different set
+ * of keywords are different decks, so the set of names is hashed, sorted.
+ * Cached decks store the names of keywords, not their IDs, so the order of
+ * keywordid does not matter.
+ * Changes to how keywords are parsed must change the format version in the
+ * cache instead.
+ */
+std::uint64_t fingerprint() {
+    static const std::uint64_t fp = [] {
+        std::vector< std::string > names( std::begin( keywordnames ),
+                                          std::end( keywordnames ) );
+        std::sort( names.begin(), names.end() );
+
+        std::string all;
+        for( const auto& name : names ) {
+            all += name;
+            all.push_back( '\0' );
+        }
+
+        return digest( all.data(), all.data() + all.size() );
+    }();
+
+    return fp;
+}
+
+}
+
+deck parser::tabulate( const char* fst,
+                       const char* lst,
+                       const tabulateopts& opts ) const {
+    deckkey key;
+    if( !opts.cache.empty() ) {
+        key.grammar = fingerprint();
+        key.content = digest( fst, lst );
+        key.size = lst - fst;
+
+        deck cached;
+        if( cache_lookup( opts.cache, key, cached ) ) return cached;
+    }
+
+    tabulator out;
+    const auto complete = drive( fst, lst, out );
+    if( !complete ) failed();
+
+    auto d = out.finish();
+    if( complete && !opts.cache.empty() ) cache_store( opts.cache, key, d );
+    return d;
+}
+
+deck parser::tabulate( const std::string& input,
+                       const tabulateopts& opts ) const {
+    return this->tabulate( input.data(), input.data() + input.size(), opts );
+}
+
+deck parser::tabulate( const std::vector< char >& input,
+                       const tabulateopts& opts ) const {
+    return this->tabulate( input.data(), input.data() + input.size(), opts );
+}
+
+/*
+ * The keywords are kept in a deque, so that they never move when the index
+ * grows. The mutex guards the deque and the skimming, and every keyword is
+ * parsed once by whichever thread reads it first, outside the mutex.
+ */
+struct index::impl {
+    struct slot {
+        slot( keywordid i, std::string n, const char* b, const char* e ) :
+            id( i ), name( std::move( n ) ), body( b ), end( e )
+        {}
+
+        keywordid id;
+        std::string name;
+        const char* body;
+        const char* end;
+
+        std::once_flag once;
+        lun::keyword kw;
+    };
+
+    impl( const char* f, const char* l ) : fst( f ), lst( l ) {}
+
+    /* the nth keyword, skimming as far as needed, or nullptr */
+    slot* at( std::size_t n ) {
+        std::lock_guard< std::mutex > lock( this->mutex );
+
+        while( this->kws.size() <= n && this->fst != this->lst ) {
+            skimmer out;
+            switch( lun::next( this->fst, this->lst, out ) ) {
+                case status::more:
+                    this->kws.emplace_back(
+                        out.id,
+                        std::string( out.name, out.body ),
+                        out.body,
+                        this->fst
+                    );
+                    break;
+
+                case status::failed:
+                    failed();
+                    /* fallthrough */
+
+                case status::done:
+                    this->fst = this->lst;
+                    break;
+            }
+        }
+
+        if( n >= this->kws.size() ) return nullptr;
+        return &this->kws[ n ];
+    }
+
+    slot& get( std::size_t n ) {
+        auto* x = this->at( n );
+        if( !x ) throw std::out_of_range( "index: no keyword "
+                                        + std::to_string( n ) );
+        return *x;
+    }
+
+    std::mutex mutex;
+    const char* fst;
+    const char* lst;
+    std::deque< slot > kws;
+};
+
+index::index( std::shared_ptr< impl > x ) : p( std::move( x ) ) {}
+
+std::size_t index::size() const {
+    if( !this->p ) return 0;
+    this->p->at( std::size_t( -1 ) );
+    std::lock_guard< std::mutex > lock( this->p->mutex );
+    return this->p->kws.size();
+}
+
+bool index::empty() const {
+    return !this->p || !this->p->at( 0 );
+}
+
+const std::string& index::name( std::size_t n ) const {
+    if( !this->p ) throw std::out_of_range( "index: no keyword "
+                                          + std::to_string( n ) );
+    return this->p->get( n ).name;
+}
+
+const keyword& index::operator[]( std::size_t n ) const {
+    if( !this->p ) throw std::out_of_range( "index: no keyword "
+                                          + std::to_string( n ) );
+
+    auto& x = this->p->get( n );
+    std::call_once( x.once, [&x] {
+        /*
+         * the body was skimmed, so the records end where the body ends, if
+         * they are well-formed. If not, call_once throws, and the next read
+         * will try (and fail) again.
+         */
+        const auto& kws = keywords< collector >();
+        collector out;
+        out.keyword( x.id, x.name.data(), x.name.data() + x.name.size() );
+
+        auto fst = x.body;
+        if( !kws[ std::size_t( x.id ) ]( fst, x.end, out ) || fst != x.end )
+            throw std::runtime_error( "Invalid " + x.name );
+
+        out.commit();
+        x.kw = std::move( out.sec.back() );
+    });
+
+    return x.kw;
+}
+
+const keyword* index::find( const std::string& name ) const {
+    if( !this->p ) return nullptr;
+
+    for( std::size_t i = 0; auto* x = this->p->at( i ); ++i )
+        if( x->name == name ) return &(*this)[ i ];
+
+    return nullptr;
+}
+
+index parser::scan( const char* fst, const char* lst ) const {
+    return index( std::make_shared< index::impl >( fst, lst ) );
+}
+
+index parser::scan( const std::string& input ) const {
+    return this->scan( input.data(), input.data() + input.size() );
+}
+
+index parser::scan( const std::vector< char >& input ) const {
+    return this->scan( input.data(), input.data() + input.size() );
+}
+
+namespace {
+
+template< typename Sink >
+bool resume( const char*& fst, const char* lst, Sink& out,
+             std::vector< std::size_t >& ends,
+             const char* base,
+             std::function< bool( std::size_t ) > stop ) {
+    for( ;; ) {
+        switch( next( fst, lst, out ) ) {
+            case status::done:   return true;
+            case status::failed: return false;
+            case status::more:   break;
+        }
+
+        ends.push_back( fst - base );
+        if( stop( ends.back() ) ) return true;
+    }
+}
+
+/*
+ * The length of the common prefix and suffix of [a, a + n) and [b, b + m),
+ * compared a block at a time, with memcmp, and then a byte at a time in the
+ * first block that differs. The suffix never overlaps the prefix.
+ */
+constexpr std::size_t cmpblock = 1 << 12;
+
+std::size_t common_prefix( const char* a, std::size_t n,
+                           const char* b, std::size_t m ) {
+    const auto len = std::min( n, m );
+    std::size_t i = 0;
+    while( i + cmpblock <= len && std::memcmp( a + i, b + i, cmpblock ) == 0 )
+        i += cmpblock;
+    while( i < len && a[ i ] == b[ i ] ) ++i;
+    return i;
+}
+
+std::size_t common_suffix( const char* a, std::size_t n,
+                           const char* b, std::size_t m,
+                           std::size_t prefix ) {
+    const auto len = std::min( n, m ) - prefix;
+    const auto* x = a + n;
+    const auto* y = b + m;
+    std::size_t i = 0;
+    while( i + cmpblock <= len
+        && std::memcmp( x - i - cmpblock, y - i - cmpblock, cmpblock ) == 0 )
+        i += cmpblock;
+    while( i < len && x[ -1 - std::ptrdiff_t( i ) ] == y[ -1 - std::ptrdiff_t( i ) ] )
+        ++i;
+    return i;
+}
+
+}
+
+tracked track( const char* fst, const char* lst ) {
+    collector out;
+    tracked deck;
+    const auto* base = fst;
+    deck.complete = resume( fst, lst, out, deck.ends, base,
+                            []( std::size_t ) { return false; } );
+    if( !deck.complete ) failed();
+    deck.kws = std::move( out.sec );
+    return deck;
+}
+
+std::size_t retrack( tracked& deck,
+                     const char* oldfst,
+                     const char* oldlst,
+                     const char* fst,
+                     const char* lst ) {
+    const std::size_t oldsize = oldlst - oldfst;
+    const std::size_t size = lst - fst;
+    const auto prefix = common_prefix( oldfst, oldsize, fst, size );
+    const auto suffix = common_suffix( oldfst, oldsize, fst, size, prefix );
+
+    /*
+     * a keyword looks at the byte it ends on, e.g. to see that a keyword
+     * name is a whole word, so only the keywords that end strictly before the
+     * first changed byte are certain to be the same
+     */
+    auto& ends = deck.ends;
+    const auto keep = std::size_t(
+        std::lower_bound( ends.begin(), ends.end(), prefix ) - ends.begin()
+    );
+
+    const std::size_t start = keep > 0 ? ends[ keep - 1 ] : 0;
+    const auto delta = std::ptrdiff_t( size ) - std::ptrdiff_t( oldsize );
+
+    /* the old keyword that ends where the new parse is, if in the suffix */
+    std::size_t resync = ends.size();
+    const auto stop = [&]( std::size_t end ) {
+        if( end < size - suffix ) return false;
+
+        const auto old = std::size_t( std::ptrdiff_t( end ) - delta );
+        const auto itr = std::lower_bound( ends.begin() + keep, ends.end(), old );
+        if( itr == ends.end() || *itr != old ) return false;
+
+        resync = itr - ends.begin();
+        return true;
+    };
+
+    collector out;
+    std::vector< std::size_t > newends;
+    auto cur = fst + start;
+    const auto ok = resume( cur, lst, out, newends, fst, stop );
+
+    const auto parsed = out.sec.size();
+    auto& kws = deck.kws;
+
+    if( resync < ends.size() ) {
+        /* the rest is the old parse, moved by delta */
+        for( auto i = resync + 1; i < ends.size(); ++i )
+            ends[ i ] = std::size_t( std::ptrdiff_t( ends[ i ] ) + delta );
+        ends.erase( ends.begin() + keep, ends.begin() + resync + 1 );
+        kws.erase( kws.begin() + keep, kws.begin() + resync + 1 );
+    } else {
+        ends.erase( ends.begin() + keep, ends.end() );
+        kws.erase( kws.begin() + keep, kws.end() );
+        deck.complete = ok;
+        if( !ok ) failed();
+    }
+
+    ends.insert( ends.begin() + keep, newends.begin(), newends.end() );
+    kws.insert( kws.begin() + keep, std::make_move_iterator( out.sec.begin() ),
+                                    std::make_move_iterator( out.sec.end() ) );
+    return parsed;
+}
+
+namespace {
+
+const parser& shared() {
+    static const parser p;
+    return p;
+}
+
+}
+
+std::vector< keyword > parse( const char* fst, const char* lst,
+                              const parseopts& opts ) {
+    return shared().parse( fst, lst, opts );
+}
+
+std::vector< keyword > parse( std::string::const_iterator fst,
+                              std::string::const_iterator lst,
+                              const parseopts& opts ) {
+    /* string iterators are contiguous, but can't be dereferenced at end */
+    if( fst == lst ) return parse( nullptr, nullptr, opts );
+
+    const char* begin = &*fst;
+    return parse( begin, begin + ( lst - fst ), opts );
+}
+
+std::vector< keyword > parse( const std::string& input,
+                              const parseopts& opts ) {
+    return parse( input.data(), input.data() + input.size(), opts );
+}
+
+std::vector< keyword > parse( const std::vector< char >& input,
+                              const parseopts& opts ) {
+    return parse( input.data(), input.data() + input.size(), opts );
+}
+
+deck tabulate( const char* fst, const char* lst,
+               const tabulateopts& opts ) {
+    return shared().tabulate( fst, lst, opts );
+}
+
+deck tabulate( const std::string& input, const tabulateopts& opts ) {
+    return tabulate( input.data(), input.data() + input.size(), opts );
+}
+
+deck tabulate( const std::vector< char >& input, const tabulateopts& opts ) {
+    return tabulate( input.data(), input.data() + input.size(), opts );
+}
+
+index scan( const char* fst, const char* lst ) {
+    return shared().scan( fst, lst );
+}
+
+index scan( const std::string& input ) {
+    return scan( input.data(), input.data() + input.size() );
+}
+
+index scan( const std::vector< char >& input ) {
+    return scan( input.data(), input.data() + input.size() );
+}
+
 }
@@ -0,0 +1,109 @@
+#ifndef LUNAR_CACHE
+#define LUNAR_CACHE
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <lunar/parser.hpp>
+
+namespace lun {
+
+/*
+ * The identity of a file, as seen when it was opened. If any of these
+ * change, the file must be assumed to have changed.
+ */
+struct fileid {
+    std::uint64_t dev   = 0;
+    std::uint64_t ino   = 0;
+    std::uint64_t size  = 0;
+    std::int64_t  mtime = 0; // nanoseconds
+};
+
+bool operator==( const fileid&, const fileid& );
+bool operator!=( const fileid&, const fileid& );
+
+/* stat path - throws std::system_error if it can't */
+fileid identify( const std::string& path );
+/* fstat the open file fd - path is only used in errors */
+fileid identify( int fd, const std::string& path );
+
+/*
+ * Everything that determines the output of concatenate, except for the
+ * contents of the files themselves.
+ */
+struct manifest {
+    std::vector< std::string > included;
+    std::vector< fileid > ids;
+    std::vector< std::pair< std::string, std::string > > aliases;
+
+    /* the source map, if the output was built with one */
+    bool mapped = false;
+    sourcemap map;
+};
+
+/*
+ * The concatenate cache is a directory of entries, one per root file, each
+ * holding the complete output of a previous run, and the manifest it was
+ * built from. An entry is valid as long as every file in the manifest still
+ * has the same identity (device, inode, size and mtime).
+ *
+ * The cache is best-effort: a missing, corrupt or stale entry is a miss, and
+ * failing to write an entry is silently ignored.
+ */
+struct cached {
+    rope::chunk output;
+    rope::owner owner;
+    std::vector< std::string > included;
+    bool mapped = false;
+    sourcemap map;
+};
+
+bool cache_lookup( const std::string& dir, const std::string& root, cached& );
+
+class cachewriter {
+    public:
+        cachewriter( const std::string& dir, const std::string& root );
+        ~cachewriter();
+
+        cachewriter( const cachewriter& ) = delete;
+        cachewriter& operator=( const cachewriter& ) = delete;
+
+        void write( const char* fst, const char* lst );
+
+        /* finish the entry and atomically make it visible to lookups */
+        void commit( const manifest& );
+
+    private:
+        struct impl;
+        std::unique_ptr< impl > p;
+};
+
+/*
+ * The deck cache is a directory of tabulated decks, keyed by the contents of
+ * the input, and the grammar it was parsed with. An entry is the columns of
+ * the deck, at offsets given by a directory in its header, so a hit is just
+ * a mapping of the entry - the deck is read straight from the file, and
+ * nothing is copied or deserialised.
+ *
+ * Like the concatenate cache, this cache is best-effort, and only meant to be
+ * read on the machine that wrote it. Entries are checked for size and
+ * consistency, but their contents are trusted.
+ */
+struct deckkey {
+    std::uint64_t grammar = 0;
+    std::uint64_t content = 0; // digest() of the input
+    std::uint64_t size    = 0; // of the input
+};
+
+/* a fast 64-bit hash of [fst, lst), for keying the cache by contents */
+std::uint64_t digest( const char* fst, const char* lst );
+
+bool cache_lookup( const std::string& dir, const deckkey&, deck& );
+void cache_store( const std::string& dir, const deckkey&, const deck& );
+
+}
+
+#endif // LUNAR_CACHE
@@ -0,0 +1,157 @@
+#ifndef LUNAR_COLUMN
+#define LUNAR_COLUMN
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <sys/mman.h>
+
+namespace lun {
+
+namespace {
+
+/*
+ * A growable array of trivially copyable T, for the columns of a deck.
+ *
+ * A std::vector grows by allocating twice the space, copying, and freeing the
+ * old, and the new pages must all be faulted in again. For a column of
+ * hundreds of megabytes, the page faults are most of the cost of tabulating,
+ * and every page is faulted about three times - twice growing, and once more
+ * when the column is shrunk to size.
+ *
+ * Small columns are malloced, but once a column is larger than mapthreshold,
+ * it is moved to an anonymous mapping of its own, which is grown and shrunk
+ * in place with mremap. That moves the page tables, not the pages, so every
+ * page is faulted in once. The mapping is advised to use huge pages, which
+ * makes faulting in a large column several times cheaper still.
+ *
+ * The memory is released in one go, when the column is destroyed.
+ */
+template< typename T >
+class column {
+    static_assert( std::is_trivially_copyable< T >::value,
+                   "columns are moved with memcpy and mremap" );
+
+    public:
+        static constexpr std::size_t mapthreshold = 1 << 20;
+
+        column() = default;
+        column( const column& ) = delete;
+        column& operator=( const column& ) = delete;
+
+        column( column&& o ) noexcept :
+            ptr( o.ptr ), len( o.len ), cap( o.cap ), mapped( o.mapped ) {
+            o.ptr = nullptr;
+            o.len = o.cap = 0;
+            o.mapped = false;
+        }
+
+        column& operator=( column&& o ) noexcept {
+            std::swap( this->ptr, o.ptr );
+            std::swap( this->len, o.len );
+            std::swap( this->cap, o.cap );
+            std::swap( this->mapped, o.mapped );
+            return *this;
+        }
+
+        ~column() {
+            if( this->mapped ) ::munmap( this->ptr, this->cap * sizeof( T ) );
+            else std::free( this->ptr );
+        }
+
+        const T* data() const { return this->ptr; }
+        T* data() { return this->ptr; }
+        std::size_t size() const { return this->len; }
+        bool empty() const { return this->len == 0; }
+
+        void push_back( const T& x ) {
+            if( this->len == this->cap ) this->reserve( this->len + 1 );
+            this->ptr[ this->len++ ] = x;
+        }
+
+        void append( const T* fst, const T* lst ) {
+            const auto n = std::size_t( lst - fst );
+            this->reserve( this->len + n );
+            if( n > 0 ) std::memcpy( this->ptr + this->len, fst, n * sizeof( T ) );
+            this->len += n;
+        }
+
+        /* grow or shrink to n. New elements are uninitialised */
+        void resize( std::size_t n ) {
+            this->reserve( n );
+            this->len = n;
+        }
+
+        void reserve( std::size_t n ) {
+            if( n <= this->cap ) return;
+            this->reallocate( std::max( n, this->cap * 2 ) );
+        }
+
+        void shrink_to_fit() {
+            if( this->len < this->cap ) this->reallocate( this->len );
+        }
+
+    private:
+        static std::size_t pages( std::size_t bytes ) {
+            const auto page = std::size_t( 1 ) << 12;
+            return ( bytes + page - 1 ) & ~( page - 1 );
+        }
+
+        void reallocate( std::size_t n ) {
+            const auto bytes = n * sizeof( T );
+
+            if( !this->mapped && bytes <= mapthreshold ) {
+                if( n == 0 ) {
+                    std::free( this->ptr );
+                    this->ptr = nullptr;
+                    this->cap = 0;
+                    return;
+                }
+
+                auto* p = std::realloc( this->ptr, bytes );
+                if( !p ) throw std::bad_alloc();
+                this->ptr = static_cast< T* >( p );
+                this->cap = n;
+                return;
+            }
+
+            /* mappings are whole pages, so use all of the last one */
+            const auto size = pages( std::max( bytes, sizeof( T ) ) );
+            void* p;
+            if( this->mapped ) {
+                p = ::mremap( this->ptr, this->cap * sizeof( T ), size,
+                              MREMAP_MAYMOVE );
+            } else {
+                p = ::mmap( nullptr, size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+            }
+
+            if( p == MAP_FAILED ) throw std::bad_alloc();
+            ::madvise( p, size, MADV_HUGEPAGE );
+
+            if( !this->mapped ) {
+                if( this->len > 0 )
+                    std::memcpy( p, this->ptr, this->len * sizeof( T ) );
+                std::free( this->ptr );
+                this->mapped = true;
+            }
+
+            this->ptr = static_cast< T* >( p );
+            this->cap = size / sizeof( T );
+        }
+
+        T* ptr = nullptr;
+        std::size_t len = 0;
+        std::size_t cap = 0;
+        bool mapped = false;
+};
+
+}
+
+}
+
+#endif // LUNAR_COLUMN
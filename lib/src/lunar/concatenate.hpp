@@ -2,11 +2,16 @@
 #define LUNAR_CONCATENATE
 
 #include <algorithm>
+#include <deque>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include <boost/functional/hash.hpp>
+#include <boost/utility/string_view.hpp>
+
 namespace lun {
 
 namespace {
@@ -16,16 +21,42 @@ class pathresolver {
 public:
     using kv = std::pair< std::string, std::string >;
 
+    pathresolver() = default;
+    pathresolver( pathresolver&& ) = default;
+    pathresolver& operator=( pathresolver&& ) = default;
+
+    /*
+     * the index points into the aliases, so a copy must be re-indexed. Moving
+     * a deque keeps the elements in place, so moves are fine
+     */
+    pathresolver( const pathresolver& o ) :
+        aliases( o.aliases ), memo( o.memo ) {
+        this->reindex();
+    }
+
+    pathresolver& operator=( const pathresolver& o ) {
+        if( this == &o ) return *this;
+        this->aliases = o.aliases;
+        this->memo = o.memo;
+        this->reindex();
+        return *this;
+    }
+
     std::string resolve( const std::string& key ) {
         /*
-         * Searching in reverse order and always appending we get set-like
-         * behaviour (since later entries would be found first).
+         * Generated decks can have hundreds of aliases, and include thousands
+         * of files by a handful of patterns, so aliases are looked up in a
+         * hash table, and results are remembered until the next insert.
          *
-         * Paths aliases are few, and likely to be created not long before
-         * they're used, so searching from the back should give fewer
-         * comparisons (and regardless of method - a trivial amount)
+         * Aliases are looked up by views into the key, so the scan itself
+         * doesn't allocate.
          */
 
+        if( key.find( '$' ) == std::string::npos ) return key;
+
+        const auto hit = this->memo.find( key );
+        if( hit != this->memo.end() ) return hit->second;
+
         std::string path;
 
         auto sigil_end = []( char c ) {
@@ -38,39 +69,63 @@ public:
             const auto fst = std::find( begin, end, '$' );
 
             path.insert( path.end(), begin, fst );
-            if( fst == end ) return path;
+            if( fst == end ) break;
 
             const auto lst = std::find_if( fst + 1, end, sigil_end );
 
-            /* store without the leading $ */
-            std::string alias( fst + 1, lst );
-
-            auto matches = [&alias]( const auto& x ) {
-                return x.first == alias;
-            };
+            /* look up without the leading $ */
+            const boost::string_view alias( &*fst + 1, lst - fst - 1 );
+            const auto itr = this->index.find( alias );
 
-            const auto itr = std::find_if( this->aliases.rbegin(),
-                                           this->aliases.rend(),
-                                           matches );
-
-            if( itr == this->aliases.rend() )
+            if( itr == this->index.end() )
                 throw std::runtime_error( "Unable to substitute alias " + key );
 
-            path.append( itr->second );
+            path.append( *itr->second );
 
             begin = lst;
-            if( begin == end ) return path;
+            if( begin == end ) break;
         }
+
+        this->memo.emplace( key, path );
+        return path;
     }
 
     template< typename Itr >
     void insert( Itr fst, Itr lst ) {
-        auto end = this->aliases.end();
-        this->aliases.insert( end, fst, lst );
+        /*
+         * Later definitions replace earlier ones in the index, which gives
+         * set-like behaviour. The earlier definitions are kept, since they
+         * still back the keys of the index.
+         */
+        for( ; fst != lst; ++fst ) {
+            this->aliases.push_back( *fst );
+            this->add( this->aliases.back() );
+        }
+
+        this->memo.clear();
     }
 
 private:
-    std::vector< kv > aliases;
+    void add( const kv& x ) {
+        const boost::string_view key( x.first );
+        this->index[ key ] = &x.second;
+    }
+
+    void reindex() {
+        this->index.clear();
+        for( const auto& x : this->aliases )
+            this->add( x );
+    }
+
+    using table = std::unordered_map<
+        boost::string_view,
+        const std::string*,
+        boost::hash< boost::string_view >
+    >;
+
+    std::deque< kv > aliases;
+    table index;
+    std::unordered_map< std::string, std::string > memo;
 };
 
 }
@@ -0,0 +1,201 @@
+#ifndef LUNAR_DECK
+#define LUNAR_DECK
+
+#include <cstdint>
+#include <memory>
+
+#include <lunar/column.hpp>
+#include <lunar/parser.hpp>
+
+namespace lun {
+
+namespace {
+
+/*
+ * Builds the columns of a deck, a keyword at a time. It's the sink the lexer
+ * writes to when tabulating, and the columns are moved into the deck when
+ * it's done.
+ */
+class tabulator {
+    public:
+        tabulator() {
+            this->strings.push_back( 0 );
+            this->records.push_back( deck::offsets{ 0, 0, 0, 0, 0 } );
+        }
+
+        void integer( int x, int repeat ) {
+            this->tag( deck::type::integer, repeat );
+            this->ints.push_back( x );
+        }
+
+        void real( double x, int repeat ) {
+            this->tag( deck::type::real, repeat );
+            this->doubles.push_back( x );
+        }
+
+        void integers( const int* fst, const int* lst, const int* repeats ) {
+            this->tag( deck::type::integer, lst - fst, repeats );
+            this->ints.append( fst, lst );
+        }
+
+        void reals( const double* fst, const double* lst, const int* repeats ) {
+            this->tag( deck::type::real, lst - fst, repeats );
+            this->doubles.append( fst, lst );
+        }
+
+        void string( const char* fst, const char* lst, int repeat ) {
+            this->tag( deck::type::string, repeat );
+            this->pool.append( fst, lst );
+            this->strings.push_back( this->pool.size() );
+        }
+
+        void none( int repeat ) {
+            this->tag( deck::type::none, repeat );
+        }
+
+        void endrec() {
+            this->tag( deck::type::endrec, 0 );
+            this->records.push_back( deck::offsets{
+                this->tags.size(),
+                this->ints.size(),
+                this->doubles.size(),
+                this->strings.size() - 1,
+                this->repeats.size(),
+            });
+        }
+
+        struct position {
+            std::size_t tags, ints, doubles, strings, pool, repeats;
+            std::size_t records, keywords, names;
+        };
+
+        position mark() const {
+            return {
+                this->tags.size(),
+                this->ints.size(),
+                this->doubles.size(),
+                this->strings.size(),
+                this->pool.size(),
+                this->repeats.size(),
+                this->records.size(),
+                this->keywords.size(),
+                this->names.size(),
+            };
+        }
+
+        void rollback( const position& p ) {
+            this->tags.resize( p.tags );
+            this->ints.resize( p.ints );
+            this->doubles.resize( p.doubles );
+            this->strings.resize( p.strings );
+            this->pool.resize( p.pool );
+            this->repeats.resize( p.repeats );
+            this->records.resize( p.records );
+            this->keywords.resize( p.keywords );
+            this->names.resize( p.names );
+        }
+
+        /*
+         * Start a new keyword. Its records are everything written until the
+         * next keyword, or until it's aborted.
+         */
+        void keyword( keywordid, const char* fst, const char* lst ) {
+            this->start = this->mark();
+            this->keywords.push_back( deck::entry{
+                this->records.size() - 1,
+                this->names.size(),
+            });
+            this->names.append( fst, lst );
+        }
+
+        void commit() {}
+
+        void abort() {
+            this->rollback( this->start );
+        }
+
+        deck finish() {
+            this->keywords.push_back( deck::entry{
+                this->records.size() - 1,
+                this->names.size(),
+            });
+
+            /* the columns grew by doubling, so trim them before handing over */
+            auto store = std::make_shared< tabulator >( std::move( *this ) );
+            store->shrink();
+
+            const auto cols = deck::columns{
+                view( store->tags ),
+                view( store->ints ),
+                view( store->doubles ),
+                view( store->strings ),
+                view( store->pool ),
+                view( store->repeats ),
+                view( store->records ),
+                view( store->keywords ),
+                view( store->names ),
+            };
+
+            return deck( cols, std::move( store ) );
+        }
+
+    private:
+        void shrink() {
+            this->tags.shrink_to_fit();
+            this->ints.shrink_to_fit();
+            this->doubles.shrink_to_fit();
+            this->strings.shrink_to_fit();
+            this->pool.shrink_to_fit();
+            this->repeats.shrink_to_fit();
+            this->records.shrink_to_fit();
+            this->keywords.shrink_to_fit();
+            this->names.shrink_to_fit();
+        }
+
+        void tag( deck::type t, int repeat ) {
+            auto x = std::uint8_t( t );
+            if( repeat ) {
+                x |= deck::repeated;
+                this->repeats.push_back( repeat );
+            }
+            this->tags.push_back( x );
+        }
+
+        /* tag n items at once */
+        void tag( deck::type t, std::size_t n, const int* repeats ) {
+            const auto size = this->tags.size();
+            this->tags.resize( size + n );
+            auto* out = this->tags.data() + size;
+
+            for( std::size_t i = 0; i < n; ++i ) {
+                out[ i ] = std::uint8_t( t );
+                if( repeats[ i ] ) {
+                    out[ i ] |= deck::repeated;
+                    this->repeats.push_back( repeats[ i ] );
+                }
+            }
+        }
+
+        template< typename T >
+        static span< const T > view( const column< T >& xs ) {
+            return { xs.data(), xs.data() + xs.size() };
+        }
+
+        column< std::uint8_t > tags;
+        column< int > ints;
+        column< double > doubles;
+        column< std::size_t > strings;
+        column< char > pool;
+        column< int > repeats;
+        column< deck::offsets > records;
+        column< deck::entry > keywords;
+        column< char > names;
+
+        position start = {};
+};
+
+}
+
+}
+
+#endif // LUNAR_DECK
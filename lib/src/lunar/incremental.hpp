@@ -0,0 +1,44 @@
+#ifndef LUNAR_INCREMENTAL
+#define LUNAR_INCREMENTAL
+
+#include <cstddef>
+#include <vector>
+
+#include <lunar/parser.hpp>
+
+namespace lun {
+
+/*
+ * A parsed deck, which remembers where in the input every keyword ended, so
+ * that it can be brought up to date with a changed input by re-parsing only
+ * the keywords that changed.
+ */
+struct tracked {
+    std::vector< keyword > kws;
+    std::vector< std::size_t > ends; // offset of the end of every keyword
+    bool complete = true;
+};
+
+tracked track( const char* fst, const char* lst );
+
+/*
+ * Bring deck, which was parsed from [oldfst, oldlst), up to date with the
+ * input [fst, lst), and return the number of keywords that were parsed.
+ *
+ * The parser is a loop over keywords with no state between them, so the parse
+ * from any keyword boundary only depends on the input after it. Keywords that
+ * end before the first changed byte are kept, and the keywords after that are
+ * parsed until the parse is at what was a keyword boundary of the old parse,
+ * in the part of the input that's unchanged at the end. From there on, the
+ * old keywords are kept. The result is always the same as parsing the new
+ * input from scratch.
+ */
+std::size_t retrack( tracked& deck,
+                     const char* oldfst,
+                     const char* oldlst,
+                     const char* fst,
+                     const char* lst );
+
+}
+
+#endif // LUNAR_INCREMENTAL
@@ -0,0 +1,172 @@
+#ifndef LUNAR_KEYWORDS
+#define LUNAR_KEYWORDS
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <lunar/parser.hpp>
+
+namespace lun {
+
+namespace {
+
+/* the names of the keywords, in the order of keywordid */
+#define LUNAR_KEYWORD_NAME( name ) #name,
+
+constexpr const char* keywordnames[] = {
+    LUNAR_KEYWORD_LIST( LUNAR_KEYWORD_NAME )
+};
+
+#undef LUNAR_KEYWORD_NAME
+
+constexpr std::size_t nkeywords = sizeof( keywordnames ) / sizeof( keywordnames[ 0 ] );
+static_assert( nkeywords == std::size_t( keywordid::unknown ),
+               "keywordnames must have a name for every keywordid" );
+static_assert( nkeywords < 0xFFFF, "keyword IDs + 1 must fit in a slot" );
+
+constexpr std::size_t length( const char* s ) {
+    std::size_t n = 0;
+    while( s[ n ] ) ++n;
+    return n;
+}
+
+constexpr int log2ceil( std::size_t n ) {
+    int bits = 0;
+    while( ( std::size_t( 1 ) << bits ) < n ) ++bits;
+    return bits;
+}
+
+/*
+ * The perfect hash of the keyword names, by hash-and-displace. A name is
+ * hashed once with FNV-1a, and the top bits of the hash pick a bucket of at
+ * most three names on average. Every bucket has a displacement, which is
+ * mixed into the hash to pick the slot, which holds the ID + 1 of the only
+ * keyword that can have that name, or 0.
+ *
+ * The displacements are searched for at compile time, one bucket at a time
+ * and the largest first, as the first one that puts all the names of the
+ * bucket in free slots. Every bucket is small and the slots are at most 80%
+ * full, so that takes a few tries per bucket, and the work grows linearly
+ * with the number of keywords, rather than with the chance of a single seed
+ * working for all of them.
+ *
+ * A lookup is a hash, two loads, and comparing the name with the one keyword
+ * it can be, regardless of the number of keywords.
+ */
+constexpr int bucketbits = log2ceil( ( nkeywords + 2 ) / 3 );
+constexpr int slotbits = log2ceil( nkeywords + nkeywords / 4 + 1 );
+constexpr std::size_t nbuckets = std::size_t( 1 ) << bucketbits;
+constexpr std::size_t nslots = std::size_t( 1 ) << slotbits;
+
+constexpr std::uint32_t fnv1a( const char* s, std::size_t len ) {
+    std::uint32_t h = 2166136261u;
+    for( std::size_t i = 0; i < len; ++i )
+        h = ( h ^ std::uint8_t( s[ i ] ) ) * 16777619u;
+    return h;
+}
+
+constexpr std::size_t bucket( std::uint32_t h ) {
+    return bucketbits == 0 ? 0 : h >> ( 32 - bucketbits );
+}
+
+constexpr std::size_t slot( std::uint32_t h, std::uint16_t displacement ) {
+    return slotbits == 0 ? 0
+         : ( ( h ^ displacement ) * 2654435761u ) >> ( 32 - slotbits );
+}
+
+struct keywordtable {
+    std::uint16_t displacements[ nbuckets ];
+    std::uint16_t slots[ nslots ];
+    std::uint8_t lengths[ nkeywords ];
+    std::size_t longest;
+};
+
+constexpr keywordtable perfecthash() {
+    keywordtable t = {};
+    std::uint32_t hashes[ nkeywords ] = {};
+
+    /* the names of bucket b are members[ first[ b ] .. first[ b + 1 ] ) */
+    std::size_t first[ nbuckets + 1 ] = {};
+    std::size_t members[ nkeywords ] = {};
+    std::size_t largest = 0;
+
+    for( std::size_t i = 0; i < nkeywords; ++i ) {
+        const auto len = length( keywordnames[ i ] );
+        t.lengths[ i ] = std::uint8_t( len );
+        if( len > t.longest ) t.longest = len;
+
+        hashes[ i ] = fnv1a( keywordnames[ i ], len );
+        ++first[ bucket( hashes[ i ] ) + 1 ];
+    }
+
+    for( std::size_t b = 0; b < nbuckets; ++b ) {
+        if( first[ b + 1 ] > largest ) largest = first[ b + 1 ];
+        first[ b + 1 ] += first[ b ];
+    }
+
+    std::size_t next[ nbuckets ] = {};
+    for( std::size_t b = 0; b < nbuckets; ++b ) next[ b ] = first[ b ];
+    for( std::size_t i = 0; i < nkeywords; ++i )
+        members[ next[ bucket( hashes[ i ] ) ]++ ] = i;
+
+    for( auto size = largest; size > 0; --size ) {
+        for( std::size_t b = 0; b < nbuckets; ++b ) {
+            const auto fst = first[ b ];
+            const auto lst = first[ b + 1 ];
+            if( lst - fst != size ) continue;
+
+            for( std::uint32_t d = 0;; ++d ) {
+                if( d > 0xFFFF )
+                    throw std::logic_error( "no displacement for keyword bucket" );
+
+                /* place the names, and take them back out on a collision */
+                auto placed = fst;
+                for( ; placed < lst; ++placed ) {
+                    const auto i = members[ placed ];
+                    const auto s = slot( hashes[ i ], std::uint16_t( d ) );
+                    if( t.slots[ s ] != 0 ) break;
+                    t.slots[ s ] = std::uint16_t( i + 1 );
+                }
+
+                if( placed == lst ) {
+                    t.displacements[ b ] = std::uint16_t( d );
+                    break;
+                }
+
+                while( placed > fst ) {
+                    const auto i = members[ --placed ];
+                    t.slots[ slot( hashes[ i ], std::uint16_t( d ) ) ] = 0;
+                }
+            }
+        }
+    }
+
+    return t;
+}
+
+constexpr keywordtable keywordhash = perfecthash();
+
+inline keywordid keywordof( const char* fst, const char* lst ) {
+    const auto len = std::size_t( lst - fst );
+    if( len == 0 || len > keywordhash.longest ) return keywordid::unknown;
+
+    const auto h = fnv1a( fst, len );
+    const auto d = keywordhash.displacements[ bucket( h ) ];
+    const auto x = keywordhash.slots[ slot( h, d ) ];
+    if( x == 0 ) return keywordid::unknown;
+
+    const auto id = std::size_t( x - 1 );
+    if( keywordhash.lengths[ id ] != len ) return keywordid::unknown;
+    if( std::memcmp( keywordnames[ id ], fst, len ) != 0 )
+        return keywordid::unknown;
+
+    return keywordid( id );
+}
+
+}
+
+}
+
+#endif // LUNAR_KEYWORDS
@@ -0,0 +1,649 @@
+#ifndef LUNAR_LEXER
+#define LUNAR_LEXER
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <locale.h>
+
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+#include <lunar/parser.hpp>
+
+namespace lun {
+
+namespace {
+
+/*
+ * A hand-written lexer for records (lists of items, terminated by /).
+ *
+ * Every item is classified by looking at it once, left to right - there is no
+ * backtracking, and no trying one alternative after another. The first
+ * character decides between number, string, default (*) and terminator, and
+ * the rest of a number decides between int and double.
+ *
+ * The items are exactly those of the Spirit grammar it replaces:
+ *
+ *  - plain values have repeat 0
+ *  - N*value has repeat N
+ *  - N* has repeat N and no value (item::none)
+ *  - * alone has repeat 0 and no value
+ *  - / is item::endrec, with repeat 1, and the rest of its line is ignored
+ *
+ * with one exception: where ints, doubles and strings are all accepted, the
+ * grammar read 2.5 as the int 2 followed by the double .5, which was a bug.
+ *
+ * The character classes are those of the "C" locale.
+ */
+
+inline bool isblank_( char c ) {
+    /* space, and \t \n \v \f \r, which are contiguous */
+    return c == ' ' || unsigned( c - '\t' ) < 5;
+}
+
+inline bool isdigit_( char c ) {
+    return unsigned( c - '0' ) < 10;
+}
+
+inline bool isalpha_( char c ) {
+    return unsigned( ( c | 0x20 ) - 'a' ) < 26;
+}
+
+inline bool isalnum_( char c ) {
+    return isalpha_( c ) || isdigit_( c );
+}
+
+/* e, E, d or D */
+inline bool ise_( char c ) {
+    return ( c | 0x20 ) == 'e' || ( c | 0x20 ) == 'd';
+}
+
+/* characters that can continue an int into a double */
+inline bool isexp_( char c ) {
+    return c == '.' || ise_( c );
+}
+
+inline bool iseol_( char c ) {
+    return c == '\n' || c == '\r';
+}
+
+/*
+ * Skip a run of blanks. Most runs are the single space between two items,
+ * so the first few blanks are skipped one at a time, and only longer runs -
+ * indentation, and the padding of fixed-width columns - are compared 16 at a
+ * time. SSE2 is part of x86-64, so there is no need to dispatch at runtime.
+ */
+inline const char* skipblanks( const char* fst, const char* lst ) {
+    for( int i = 0; i < 4; ++i ) {
+        if( fst == lst || !isblank_( *fst ) ) return fst;
+        ++fst;
+    }
+
+#ifdef __SSE2__
+    const auto space = _mm_set1_epi8( ' ' );
+    const auto tab   = _mm_set1_epi8( '\t' );
+    const auto four  = _mm_set1_epi8( 4 );
+    for( ; lst - fst >= 16; fst += 16 ) {
+        const auto x = _mm_loadu_si128( (const __m128i*)fst );
+        /* x - \t <= 4, unsigned, is \t \n \v \f \r */
+        const auto t = _mm_sub_epi8( x, tab );
+        const auto ctrl = _mm_cmpeq_epi8( _mm_min_epu8( t, four ), t );
+        const auto blank = _mm_or_si128( ctrl, _mm_cmpeq_epi8( x, space ) );
+
+        const auto mask = unsigned( _mm_movemask_epi8( blank ) );
+        if( mask != 0xFFFF ) return fst + __builtin_ctz( ~mask );
+    }
+#endif
+
+    while( fst != lst && isblank_( *fst ) ) ++fst;
+    return fst;
+}
+
+/*
+ * Skip blanks and -- comments. A comment is skipped with memchr to the end of
+ * the line, which is the first \n, unless there is a \r before it.
+ */
+__attribute__(( noinline ))
+inline const char* skipmore( const char* fst, const char* lst ) {
+    for( ;; ) {
+        fst = skipblanks( fst, lst );
+        if( lst - fst < 2 || fst[ 0 ] != '-' || fst[ 1 ] != '-' ) return fst;
+
+        fst += 2;
+        const auto* eol = static_cast< const char* >(
+            std::memchr( fst, '\n', lst - fst )
+        );
+        if( !eol ) eol = lst;
+
+        const auto* cr = static_cast< const char* >(
+            std::memchr( fst, '\r', eol - fst )
+        );
+        fst = cr ? cr : eol;
+    }
+}
+
+/*
+ * skipmore(), but the single space that separates most items is checked for
+ * inline, without a call.
+ */
+inline const char* skipws( const char* fst, const char* lst ) {
+    if( lst - fst >= 2 && fst[ 0 ] == ' '
+     && !isblank_( fst[ 1 ] ) && fst[ 1 ] != '-' )
+        return fst + 1;
+
+    return skipmore( fst, lst );
+}
+
+/*
+ * [+-]digits, which must fit in an int
+ */
+inline bool lexint( const char*& fst, const char* lst, int& x ) {
+    auto p = fst;
+    bool neg = false;
+    if( p != lst && ( *p == '-' || *p == '+' ) ) neg = *p++ == '-';
+
+    if( p == lst || !isdigit_( *p ) ) return false;
+
+    const std::int64_t limit = neg ? 2147483648LL : 2147483647LL;
+    std::int64_t acc = 0;
+    for( ; p != lst && isdigit_( *p ); ++p ) {
+        acc = acc * 10 + ( *p - '0' );
+        if( acc > limit ) return false;
+    }
+
+    x = int( neg ? -acc : acc );
+    fst = p;
+    return true;
+}
+
+/* the powers of ten that are exact doubles */
+constexpr double powersof10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21,
+    1e22,
+};
+
+/*
+ * Fortran-style floating point: [+-]digits[.digits][(e|E|d|D)[+-]digits],
+ * where either the leading or the trailing digits of the dot can be omitted
+ * (but not both), and an exponent without digits is not part of the number.
+ * nan, inf and infinity are accepted in any case.
+ *
+ * Up to 15 digits with a small exponent, which is all the typical deck has,
+ * are converted exactly without strtod.
+ */
+__attribute__(( noinline ))
+inline bool lexdoublefull( const char*& fst, const char* lst, double& x ) {
+    auto p = fst;
+    bool neg = false;
+    if( p != lst && ( *p == '-' || *p == '+' ) ) neg = *p++ == '-';
+
+    /*
+     * all the digits, leading zeros included, go into the mantissa - if there
+     * are more than 19 of them it may have overflowed, and the number is
+     * handed to strtod instead
+     */
+    std::uint64_t mantissa = 0;
+
+    const auto* intpart = p;
+    for( ; p != lst && isdigit_( *p ); ++p )
+        mantissa = mantissa * 10 + unsigned( *p - '0' );
+    const auto intdigits = p - intpart;
+    const bool whole = intdigits > 0;
+
+    std::ptrdiff_t fracdigits = 0;
+    if( p != lst && *p == '.' ) {
+        const auto* dot = ++p;
+        for( ; p != lst && isdigit_( *p ); ++p )
+            mantissa = mantissa * 10 + unsigned( *p - '0' );
+        fracdigits = p - dot;
+    }
+    const bool frac = fracdigits > 0;
+
+    if( !whole && !frac ) {
+        /* nan, inf or infinity - or not a number at all */
+        p = fst + ( neg || ( fst != lst && *fst == '+' ) );
+        const auto word = [&]( const char* w ) {
+            const auto len = std::strlen( w );
+            if( std::size_t( lst - p ) < len ) return false;
+            for( std::size_t i = 0; i < len; ++i )
+                if( ( p[ i ] | 0x20 ) != w[ i ] ) return false;
+            p += len;
+            return true;
+        };
+
+        if( word( "nan" ) ) x = std::nan( "" );
+        else if( word( "inf" ) ) {
+            word( "inity" );
+            x = HUGE_VAL;
+        }
+        else return false;
+
+        if( neg ) x = -x;
+        fst = p;
+        return true;
+    }
+
+    const auto* end = p;
+    int exponent = 0;
+    if( p != lst && ise_( *p ) ) {
+        auto e = p + 1;
+        if( lexint( e, lst, exponent ) ) end = e;
+    }
+
+    const long e10 = long( exponent ) - fracdigits;
+    const bool exact = intdigits + fracdigits <= 19
+                    && mantissa < ( 1ULL << 53 )
+                    && e10 >= -22 && e10 <= 22;
+
+    if( exact ) {
+        /*
+         * both the mantissa and the power of ten are exact, and a single
+         * multiplication or division is correctly rounded
+         */
+        const auto m = double( mantissa );
+        x = e10 < 0 ? m / powersof10[ -e10 ] : m * powersof10[ e10 ];
+    } else {
+        /*
+         * strtod doesn't know the d exponent, and depends on the locale for
+         * the decimal point, so give it a sanitised copy in the C locale
+         */
+        static const locale_t c = newlocale( LC_ALL_MASK, "C", locale_t() );
+        std::string buffer( fst, end );
+        for( auto& ch : buffer )
+            if( ch == 'd' || ch == 'D' ) ch = 'e';
+
+        x = strtod_l( buffer.c_str(), nullptr, c );
+        if( std::isinf( x ) ) return false;
+        neg = false;
+    }
+
+    if( neg ) x = -x;
+    fst = end;
+    return true;
+}
+
+/*
+ * lexdoublefull(), but [+-]digits[.digits] without an exponent, which is
+ * almost every number in a deck, is read inline. It is converted the same
+ * way, and anything else is read again from the start by lexdoublefull().
+ */
+inline bool lexdouble( const char*& fst, const char* lst, double& x ) {
+    auto p = fst;
+    bool neg = false;
+    if( p != lst && ( *p == '-' || *p == '+' ) ) neg = *p++ == '-';
+
+    std::uint64_t mantissa = 0;
+    const auto* digits = p;
+    for( ; p != lst && isdigit_( *p ); ++p )
+        mantissa = mantissa * 10 + unsigned( *p - '0' );
+    auto ndigits = p - digits;
+
+    std::ptrdiff_t fracdigits = 0;
+    if( p != lst && *p == '.' ) {
+        const auto* dot = ++p;
+        for( ; p != lst && isdigit_( *p ); ++p )
+            mantissa = mantissa * 10 + unsigned( *p - '0' );
+        fracdigits = p - dot;
+        ndigits += fracdigits;
+    }
+
+    const bool simple = ndigits > 0
+                     && ndigits <= 19
+                     && mantissa < ( 1ULL << 53 )
+                     && fracdigits <= 22
+                     && ( p == lst || !ise_( *p ) );
+
+    if( !simple ) return lexdoublefull( fst, lst, x );
+
+    const auto m = double( mantissa ) / powersof10[ fracdigits ];
+    x = neg ? -m : m;
+    fst = p;
+    return true;
+}
+
+/*
+ * 'quoted', "quoted", or a bare word of a letter followed by letters and
+ * digits. The string is [begin, end), without the quotes.
+ */
+inline bool lexstring( const char*& fst, const char* lst,
+                       const char*& begin, const char*& end ) {
+    if( fst == lst ) return false;
+
+    if( *fst == '\'' || *fst == '"' ) {
+        const auto* close = static_cast< const char* >(
+            std::memchr( fst + 1, *fst, lst - ( fst + 1 ) )
+        );
+        if( !close ) return false;
+
+        begin = fst + 1;
+        end = close;
+        fst = close + 1;
+        return true;
+    }
+
+    if( !isalpha_( *fst ) ) return false;
+
+    auto p = fst + 1;
+    while( p != lst && isalnum_( *p ) ) ++p;
+    begin = fst;
+    end = p;
+    fst = p;
+    return true;
+}
+
+/*
+ * The lexer writes the items to a sink, which is anything with
+ *
+ *  integer( int, repeat )
+ *  real( double, repeat )
+ *  string( const char* begin, const char* end, repeat )
+ *  none( repeat )
+ *  endrec()
+ *
+ * where repeat is N for items written as N*, and 0 otherwise, and
+ *
+ *  mark()              - the current position
+ *  rollback( mark )    - discard everything written after mark
+ *
+ * and for array(), blocks of values, with the repeat of every value
+ *
+ *  integers( const int* begin, const int* end, const int* repeats )
+ *  reals( const double* begin, const double* end, const int* repeats )
+ */
+
+/*
+ * The value of an item, restricted to the types T...
+ */
+template< typename... T >
+struct value;
+
+template<>
+struct value< int > {
+    template< typename Sink >
+    static bool lex( const char*& fst, const char* lst, int repeat, Sink& out ) {
+        int i;
+        if( !lexint( fst, lst, i ) ) return false;
+        out.integer( i, repeat );
+        return true;
+    }
+};
+
+template<>
+struct value< double > {
+    template< typename Sink >
+    static bool lex( const char*& fst, const char* lst, int repeat, Sink& out ) {
+        double d;
+        if( !lexdouble( fst, lst, d ) ) return false;
+        out.real( d, repeat );
+        return true;
+    }
+};
+
+template<>
+struct value< std::string > {
+    template< typename Sink >
+    static bool lex( const char*& fst, const char* lst, int repeat, Sink& out ) {
+        const char* begin;
+        const char* end;
+        if( !lexstring( fst, lst, begin, end ) ) return false;
+        out.string( begin, end, repeat );
+        return true;
+    }
+};
+
+template<>
+struct value< int, double > {
+    template< typename Sink >
+    static bool lex( const char*& fst, const char* lst, int repeat, Sink& out ) {
+        /*
+         * an int is an int only if it isn't the start of a double - in that
+         * case, read it again as a double. This only ever looks at the
+         * digits twice, never at anything else.
+         */
+        auto p = fst;
+        int i;
+        if( lexint( p, lst, i ) ) {
+            if( p == lst || !isexp_( *p ) ) {
+                out.integer( i, repeat );
+                fst = p;
+                return true;
+            }
+        }
+
+        return value< double >::lex( fst, lst, repeat, out );
+    }
+};
+
+template<>
+struct value< int, std::string > {
+    template< typename Sink >
+    static bool lex( const char*& fst, const char* lst, int repeat, Sink& out ) {
+        return value< int >::lex( fst, lst, repeat, out )
+            || value< std::string >::lex( fst, lst, repeat, out );
+    }
+};
+
+template<>
+struct value< int, double, std::string > {
+    template< typename Sink >
+    static bool lex( const char*& fst, const char* lst, int repeat, Sink& out ) {
+        return value< int, double >::lex( fst, lst, repeat, out )
+            || value< std::string >::lex( fst, lst, repeat, out );
+    }
+};
+
+/*
+ * Lex one record of items of types T... into out, including the endrec. On
+ * success, fst is moved past the record, otherwise it's left untouched, and
+ * nothing is written to out.
+ */
+template< typename... T, typename Sink >
+bool record( const char*& fst, const char* lst, Sink& out ) {
+    auto p = fst;
+    const auto mark = out.mark();
+
+    for( ;; ) {
+        p = skipws( p, lst );
+        if( p == lst ) break;
+
+        if( *p == '/' ) {
+            /* the rest of the line after / is ignored */
+            while( p != lst && !iseol_( *p ) ) ++p;
+            out.endrec();
+            fst = p;
+            return true;
+        }
+
+        if( *p == '*' ) {
+            ++p;
+            out.none( 0 );
+            continue;
+        }
+
+        /*
+         * a number directly followed by * is a repeat, and otherwise the
+         * item is just a value, which must not be followed by *. Scanning
+         * ahead for the * is cheaper than reading the number twice.
+         */
+        auto q = p;
+        if( q != lst && ( *q == '-' || *q == '+' ) ) ++q;
+        while( q != lst && isdigit_( *q ) ) ++q;
+
+        int repeat;
+        if( q != lst && *q == '*' && lexint( p, lst, repeat ) ) {
+            p = q + 1;
+            if( !value< T... >::lex( p, lst, repeat, out ) )
+                out.none( repeat );
+            continue;
+        }
+
+        if( !value< T... >::lex( p, lst, 0, out ) ) break;
+        if( p != lst && *p == '*' ) break;
+    }
+
+    out.rollback( mark );
+    return false;
+}
+
+inline bool lexnum( const char*& fst, const char* lst, int& x ) {
+    return lexint( fst, lst, x );
+}
+
+inline bool lexnum( const char*& fst, const char* lst, double& x ) {
+    return lexdouble( fst, lst, x );
+}
+
+template< typename Sink >
+void put( Sink& out, const int* fst, const int* lst, const int* repeats ) {
+    out.integers( fst, lst, repeats );
+}
+
+template< typename Sink >
+void put( Sink& out, const double* fst, const double* lst, const int* repeats ) {
+    out.reals( fst, lst, repeats );
+}
+
+/*
+ * One record of numbers of type T (int or double), with exactly the items of
+ * record< T >, for the large arrays of GRID, which can be billions of values.
+ *
+ * Values, and their repeats, are lexed straight into a block, which is handed
+ * to the sink when full, so a sink can append them in bulk. Defaults, which
+ * are rare in arrays, are written one at a time. There is no scanning ahead
+ * for the * of N*value - the number is lexed as T, and only read again as the
+ * int N if it turns out to be followed by *.
+ */
+template< typename T, typename Sink >
+bool array( const char*& fst, const char* lst, Sink& out ) {
+    constexpr std::size_t size = 1024;
+    T block[ size ];
+    int repeats[ size ];
+    std::size_t n = 0;
+
+    const auto flush = [&] {
+        put( out, block, block + n, repeats );
+        n = 0;
+    };
+
+    auto p = fst;
+    const auto mark = out.mark();
+
+    for( ;; ) {
+        p = skipws( p, lst );
+        if( p == lst ) break;
+
+        if( *p == '/' ) {
+            flush();
+            while( p != lst && !iseol_( *p ) ) ++p;
+            out.endrec();
+            fst = p;
+            return true;
+        }
+
+        if( *p == '*' ) {
+            flush();
+            ++p;
+            out.none( 0 );
+            continue;
+        }
+
+        T x;
+        auto q = p;
+        if( !lexnum( q, lst, x ) ) break;
+
+        int repeat = 0;
+        if( q != lst && *q == '*' ) {
+            /* N*value or N*, where N must be all of the number before the * */
+            auto r = p;
+            if( !lexint( r, lst, repeat ) || r != q ) break;
+
+            p = q + 1;
+            if( !lexnum( p, lst, x ) ) {
+                flush();
+                out.none( repeat );
+                continue;
+            }
+            q = p;
+        }
+
+        block[ n ] = x;
+        repeats[ n ] = repeat;
+        p = q;
+        if( ++n == size ) flush();
+    }
+
+    out.rollback( mark );
+    return false;
+}
+
+/*
+ * Skip one record without lexing its items, and move fst to where record()
+ * would. Only quotes, comments and / are looked at, so skim() accepts records
+ * that record() would not, but for the records record() accepts, it always
+ * ends in the same place - none of the three can be inside an item.
+ */
+inline bool skim( const char*& fst, const char* lst ) {
+    struct table {
+        table() {
+            for( const unsigned char c : { '/', '\'', '"', '-' } )
+                this->special[ c ] = true;
+        }
+        bool special[ 256 ] = {};
+    };
+    static const table t;
+
+    auto p = fst;
+
+    while( p != lst ) {
+        /* most of a record is items and blanks, so get past them quickly */
+        while( p != lst && !t.special[ static_cast< unsigned char >( *p ) ] )
+            ++p;
+
+        if( p == lst ) break;
+
+        switch( *p ) {
+            case '/':
+                while( p != lst && !iseol_( *p ) ) ++p;
+                fst = p;
+                return true;
+
+            case '\'':
+            case '"': {
+                const auto* close = static_cast< const char* >(
+                    std::memchr( p + 1, *p, lst - ( p + 1 ) )
+                );
+                if( !close ) return false;
+                p = close + 1;
+                break;
+            }
+
+            case '-':
+                if( lst - p < 2 || p[ 1 ] != '-' ) {
+                    ++p;
+                    break;
+                }
+
+                p += 2;
+                while( p != lst && !iseol_( *p ) ) ++p;
+                break;
+
+            default:
+                ++p;
+        }
+    }
+
+    return false;
+}
+
+}
+
+}
+
+#endif // LUNAR_LEXER
@@ -0,0 +1,94 @@
+#ifndef LUNAR_POOL
+#define LUNAR_POOL
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lun {
+
+namespace {
+
+/*
+ * A small, fixed-size thread pool. Tasks are run in submission order, and
+ * their results (or exceptions) are delivered through futures.
+ *
+ * Destroying the pool waits for the running tasks to finish, but discards
+ * the ones still queued - their futures will report a broken promise.
+ */
+class pool {
+    public:
+        explicit pool( int threads ) {
+            for( int i = 0; i < threads; ++i )
+                this->workers.emplace_back( [this] { this->work(); } );
+        }
+
+        pool( const pool& ) = delete;
+        pool& operator=( const pool& ) = delete;
+
+        ~pool() {
+            {
+                std::lock_guard< std::mutex > lock( this->mx );
+                this->stop = true;
+                this->queue.clear();
+            }
+
+            this->cv.notify_all();
+            for( auto& w : this->workers ) w.join();
+        }
+
+        template< typename F >
+        auto submit( F f ) -> std::future< decltype( f() ) > {
+            using R = decltype( f() );
+            auto task = std::make_shared< std::packaged_task< R() > >(
+                            std::move( f ) );
+            auto fut = task->get_future();
+
+            {
+                std::lock_guard< std::mutex > lock( this->mx );
+                this->queue.emplace_back( [task] { (*task)(); } );
+            }
+
+            this->cv.notify_one();
+            return fut;
+        }
+
+        std::size_t size() const { return this->workers.size(); }
+
+    private:
+        void work() {
+            for( ;; ) {
+                std::function< void() > task;
+
+                {
+                    std::unique_lock< std::mutex > lock( this->mx );
+                    this->cv.wait( lock, [this] {
+                        return this->stop || !this->queue.empty();
+                    });
+
+                    if( this->stop ) return;
+                    task = std::move( this->queue.front() );
+                    this->queue.pop_front();
+                }
+
+                task();
+            }
+        }
+
+        std::vector< std::thread > workers;
+        std::deque< std::function< void() > > queue;
+        std::mutex mx;
+        std::condition_variable cv;
+        bool stop = false;
+};
+
+}
+
+}
+
+#endif // LUNAR_POOL
@@ -0,0 +1,61 @@
+#ifndef LUNAR_READER
+#define LUNAR_READER
+
+#include <memory>
+#include <string>
+
+#include <lunar/cache.hpp>
+#include <lunar/parser.hpp>
+
+namespace lun {
+
+/*
+ * An open input file, in memory in its entirety, either mapped or read into
+ * a buffer, depending on the reader. The identity is taken from the open file
+ * *before* it is read, so that if the file is modified while it's being read,
+ * the recorded identity is stale, rather than the contents.
+ */
+class source {
+    public:
+        virtual ~source() = default;
+
+        const char* begin() const { return this->first; }
+        const char* end() const   { return this->last; }
+        std::size_t size() const  { return this->last - this->first; }
+
+        /*
+         * [fst, lst) will not be read again by this process, so drop it from
+         * memory if it can be brought back on demand. This is only ever a
+         * hint, and a no-op for buffered files.
+         */
+        virtual void release( const char*, const char* ) const {}
+
+        fileid id;
+
+    protected:
+        const char* first = nullptr;
+        const char* last  = nullptr;
+};
+
+/*
+ * Open and read path with the given reader. reader::automatic means the
+ * reader named by the LUNAR_READER environment variable (auto, mmap, pread or
+ * uring) if set, and otherwise pread for small files, and a lazily faulted
+ * mapping for large ones.
+ *
+ * The io_uring reader falls back to pread if io_uring is unavailable, e.g.
+ * on older kernels, or if it has been disabled.
+ *
+ * gzip and zstd (if built with zstd) compressed files are detected by their
+ * magic bytes and decompressed in memory, so the source is always the plain
+ * text.
+ *
+ * Throws std::system_error if the file can't be opened or read.
+ */
+std::shared_ptr< const source > load( const std::string& path, reader );
+
+const char* reader_name( reader );
+
+}
+
+#endif // LUNAR_READER
@@ -0,0 +1,40 @@
+#ifndef LUNAR_SEARCH
+#define LUNAR_SEARCH
+
+#include <cstddef>
+
+namespace lun {
+
+/*
+ * Find the first PATHS or INCLUDE keyword in [begin, end) that is not in a
+ * comment, i.e. it is the first non-blank thing on its line, or is preceded
+ * only by blanks at begin. Returns end if there is no such keyword.
+ *
+ * search() picks the fastest kernel supported by the cpu on first use. The
+ * choice can be overriden by setting the environment variable LUNAR_SEARCH to
+ * one of scalar, sse2, avx2 or avx512, which is mostly useful for
+ * benchmarking. If the requested kernel is unavailable, the default is used.
+ */
+const char* search( const char* begin, const char* end );
+
+enum class kernel { scalar, sse2, avx2, avx512 };
+using searchfn = const char* (*)( const char*, const char* );
+
+/*
+ * The search function implemented by a specific kernel, or nullptr if it is
+ * not supported by this build or this cpu
+ */
+searchfn search_kernel( kernel );
+const char* kernel_name( kernel );
+
+/*
+ * Count the newlines in [fst, lst), with the same kernel as search().
+ */
+std::size_t newlines( const char* fst, const char* lst );
+
+using countfn = std::size_t (*)( const char*, const char* );
+countfn newline_kernel( kernel );
+
+}
+
+#endif // LUNAR_SEARCH
@@ -1,9 +1,12 @@
-#include <fstream>
+#include <cstdio>
 #include <iostream>
 #include <sstream>
-#include <streambuf>
 #include <string>
 
+#include <sys/stat.h>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
 #include <lunar/parser.hpp>
 
 std::string dot( const section& sec ) {
@@ -18,13 +21,22 @@ std::string dot( const section& sec ) {
 
 int main( int argc, char** argv ) {
     const std::string filename{ argv[ 1 ] };
-    std::ifstream fs( filename );
-    std::string input{ std::istreambuf_iterator< char >( fs ),
-                       std::istreambuf_iterator< char >() };
 
-    auto begin = input.cbegin();
-    auto end   = input.cend();
-    auto sec = parse( begin, end );
+    /*
+     * parse straight from the mapped file, rather than reading it into a
+     * string first, so that a deck never needs more memory than its size
+     */
+    struct stat st;
+    if( stat( filename.c_str(), &st ) != 0 ) {
+        std::perror( filename.c_str() );
+        return 1;
+    }
+
+    /* an empty file can't be mapped, but is a valid (empty) deck */
+    boost::iostreams::mapped_file_source input;
+    if( st.st_size > 0 ) input.open( filename );
+
+    auto sec = parse( input.begin(), input.end() );
 
     std::cout << dot( sec ) << std::endl;
 }
@@ -0,0 +1,609 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#ifdef HAVE_ZSTD
+#include <boost/iostreams/filter/zstd.hpp>
+#endif
+
+#include <lunar/reader.hpp>
+
+namespace lun {
+
+namespace {
+
+/*
+ * Files up to this size are read rather than mapped by the automatic reader.
+ * Mapping a file costs a couple of syscalls, and a page fault per page, which
+ * for the typical small .inc file is a lot more than just reading it. Buffers
+ * of this size or smaller are also recycled.
+ */
+constexpr std::size_t smallfile = 1 << 16;
+
+[[noreturn]]
+void fail( const std::string& path ) {
+    throw std::system_error( errno, std::generic_category(), path );
+}
+
+struct descriptor {
+    explicit descriptor( const std::string& path ) :
+        fd( ::open( path.c_str(), O_RDONLY | O_CLOEXEC ) ) {
+        if( this->fd < 0 ) fail( path );
+    }
+
+    ~descriptor() { ::close( this->fd ); }
+
+    descriptor( const descriptor& ) = delete;
+    descriptor& operator=( const descriptor& ) = delete;
+
+    int fd;
+};
+
+class mapped : public source {
+    public:
+        mapped( const descriptor& f,
+                const fileid& identity,
+                const std::string& path,
+                bool populate ) {
+            this->id = identity;
+            this->len = identity.size;
+            if( this->len == 0 ) return;
+
+            const auto flags = MAP_PRIVATE | ( populate ? MAP_POPULATE : 0 );
+            this->addr = ::mmap( nullptr, this->len, PROT_READ, flags, f.fd, 0 );
+            if( this->addr == MAP_FAILED ) fail( path );
+
+            /*
+             * the file is read start to end, so ask for aggressive readahead,
+             * and unless the mapping is already populated, start it now
+             */
+            ::madvise( this->addr, this->len, MADV_SEQUENTIAL );
+            if( !populate ) ::madvise( this->addr, this->len, MADV_WILLNEED );
+
+            this->first = static_cast< const char* >( this->addr );
+            this->last = this->first + this->len;
+        }
+
+        ~mapped() override {
+            if( this->addr ) ::munmap( this->addr, this->len );
+        }
+
+        void release( const char* fst, const char* lst ) const override {
+            /*
+             * the mapping is private, but read-only, so its pages are never
+             * written to and never stop being clean copies of the file.
+             * Dropping them is always safe - they are faulted back in from the
+             * page cache if they're read again
+             */
+            static const auto pagesize = std::size_t( sysconf( _SC_PAGESIZE ) );
+            const auto mask = ~std::uintptr_t( pagesize - 1 );
+            const auto lo = ( std::uintptr_t( fst ) + pagesize - 1 ) & mask;
+            const auto hi = std::uintptr_t( lst ) & mask;
+            if( lo < hi ) ::madvise( (void*)lo, hi - lo, MADV_DONTNEED );
+        }
+
+    private:
+        void* addr = nullptr;
+        std::size_t len = 0;
+};
+
+struct buffer {
+    std::unique_ptr< char[] > data;
+    std::size_t capacity = 0;
+};
+
+/*
+ * Decks often include hundreds of small files, and handing the same few
+ * buffers around saves an allocation (and the page faults of fresh memory)
+ * per file.
+ */
+class bufferpool {
+    public:
+        buffer take( std::size_t size ) {
+            {
+                std::lock_guard< std::mutex > lock( this->mx );
+                const auto fits = [size]( const buffer& b ) {
+                    return b.capacity >= size;
+                };
+
+                auto itr = std::find_if( this->xs.begin(), this->xs.end(), fits );
+                if( itr != this->xs.end() ) {
+                    auto b = std::move( *itr );
+                    this->xs.erase( itr );
+                    return b;
+                }
+            }
+
+            buffer b;
+            b.capacity = size <= smallfile ? smallfile : size;
+            b.data.reset( new char[ b.capacity ] );
+            return b;
+        }
+
+        void give( buffer b ) {
+            if( b.capacity > smallfile ) return;
+
+            std::lock_guard< std::mutex > lock( this->mx );
+            if( this->xs.size() < 64 ) this->xs.push_back( std::move( b ) );
+        }
+
+    private:
+        std::mutex mx;
+        std::vector< buffer > xs;
+};
+
+bufferpool& buffers() {
+    /* never destroyed, so that sources can outlive static destruction */
+    static auto* pool = new bufferpool();
+    return *pool;
+}
+
+class buffered : public source {
+    public:
+        buffered( const fileid& identity, buffer b ) : buf( std::move( b ) ) {
+            this->id = identity;
+            this->first = this->buf.data.get();
+            this->last = this->first + identity.size;
+        }
+
+        ~buffered() override {
+            buffers().give( std::move( this->buf ) );
+        }
+
+    private:
+        buffer buf;
+};
+
+/*
+ * read [offset, offset + len) into dst. If the file shrunk since it was
+ * stat'd, it has been modified while being read, which is an error
+ */
+void readall( const descriptor& f,
+              const std::string& path,
+              char* dst,
+              std::size_t len,
+              std::size_t offset = 0 ) {
+    while( len > 0 ) {
+        const auto n = ::pread( f.fd, dst, len, offset );
+        if( n < 0 && errno == EINTR ) continue;
+        if( n < 0 ) fail( path );
+        if( n == 0 )
+            throw std::runtime_error( "Unexpected end of file in " + path );
+
+        dst += n;
+        len -= n;
+        offset += n;
+    }
+}
+
+/*
+ * A minimal io_uring, driven directly through the system calls, so that
+ * there is no dependency on liburing. The whole file is read as a batch of
+ * large reads, which are submitted (and completed) with a single system call
+ * for all but the largest files.
+ *
+ * A ring is created per thread on first use, and kept for the lifetime of
+ * the thread, since setting up a ring is a lot more expensive than a read.
+ */
+class ring {
+    public:
+        ring() {
+            io_uring_params p;
+            std::memset( &p, 0, sizeof( p ) );
+            this->fd = int( syscall( __NR_io_uring_setup, depth, &p ) );
+            if( this->fd < 0 ) return;
+
+            this->sqlen = p.sq_off.array + p.sq_entries * sizeof( unsigned );
+            this->cqlen = p.cq_off.cqes + p.cq_entries * sizeof( io_uring_cqe );
+            this->sqelen = p.sq_entries * sizeof( io_uring_sqe );
+
+            const bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+            if( single ) this->sqlen = this->cqlen = std::max( this->sqlen,
+                                                               this->cqlen );
+
+            const auto prot = PROT_READ | PROT_WRITE;
+            const auto flags = MAP_SHARED | MAP_POPULATE;
+            this->sq = ::mmap( nullptr, this->sqlen, prot, flags,
+                               this->fd, IORING_OFF_SQ_RING );
+            this->cq = single ? this->sq
+                     : ::mmap( nullptr, this->cqlen, prot, flags,
+                               this->fd, IORING_OFF_CQ_RING );
+            auto* sqes = ::mmap( nullptr, this->sqelen, prot, flags,
+                                 this->fd, IORING_OFF_SQES );
+
+            if( this->sq == MAP_FAILED
+             || this->cq == MAP_FAILED
+             || sqes == MAP_FAILED ) {
+                if( sqes != MAP_FAILED ) ::munmap( sqes, this->sqelen );
+                this->teardown();
+                return;
+            }
+
+            auto* sqp = static_cast< char* >( this->sq );
+            auto* cqp = static_cast< char* >( this->cq );
+            this->sqhead  = (unsigned*)( sqp + p.sq_off.head );
+            this->sqtail  = (unsigned*)( sqp + p.sq_off.tail );
+            this->sqmask  = *(unsigned*)( sqp + p.sq_off.ring_mask );
+            this->sqarray = (unsigned*)( sqp + p.sq_off.array );
+            this->cqhead  = (unsigned*)( cqp + p.cq_off.head );
+            this->cqtail  = (unsigned*)( cqp + p.cq_off.tail );
+            this->cqmask  = *(unsigned*)( cqp + p.cq_off.ring_mask );
+            this->cqes    = (io_uring_cqe*)( cqp + p.cq_off.cqes );
+            this->sqes    = static_cast< io_uring_sqe* >( sqes );
+            this->entries = p.sq_entries;
+        }
+
+        ~ring() {
+            if( this->sqes ) ::munmap( this->sqes, this->sqelen );
+            this->teardown();
+        }
+
+        ring( const ring& ) = delete;
+        ring& operator=( const ring& ) = delete;
+
+        bool ok() const { return this->sqes != nullptr; }
+
+        /*
+         * Read len bytes from the start of f into dst. Returns false if the
+         * kernel doesn't support the read operation, in which case the ring
+         * is idle, and the file must be read by other means.
+         */
+        bool read( const descriptor& f,
+                   const std::string& path,
+                   char* dst,
+                   std::size_t len ) {
+            const std::size_t pieces = ( len + piece - 1 ) / piece;
+            std::size_t submitted = 0;
+            std::size_t completed = 0;
+            int error = 0;
+
+            /*
+             * short reads are rare, so just finish them synchronously, but
+             * only once nothing is in flight anymore
+             */
+            std::vector< std::pair< std::size_t, std::size_t > > rest;
+
+            const auto size = [len]( std::size_t i ) {
+                return std::min( piece, len - i * piece );
+            };
+
+            while( completed < submitted || ( submitted < pieces && !error ) ) {
+                auto tail = *this->sqtail;
+                while( !error
+                    && submitted < pieces
+                    && submitted - completed < this->entries ) {
+                    const auto idx = tail & this->sqmask;
+                    auto& sqe = this->sqes[ idx ];
+                    std::memset( &sqe, 0, sizeof( sqe ) );
+                    sqe.opcode = IORING_OP_READ;
+                    sqe.fd = f.fd;
+                    sqe.off = submitted * piece;
+                    sqe.addr = std::uintptr_t( dst + submitted * piece );
+                    sqe.len = unsigned( size( submitted ) );
+                    sqe.user_data = submitted;
+                    this->sqarray[ idx ] = idx;
+                    ++tail;
+                    ++submitted;
+                }
+                __atomic_store_n( this->sqtail, tail, __ATOMIC_RELEASE );
+
+                const auto pending = tail - __atomic_load_n( this->sqhead,
+                                                             __ATOMIC_ACQUIRE );
+                const auto n = syscall( __NR_io_uring_enter, this->fd,
+                                        pending, 1, IORING_ENTER_GETEVENTS,
+                                        nullptr, 0 );
+                if( n < 0 && errno != EINTR && errno != EAGAIN ) {
+                    /*
+                     * the ring itself is broken - nothing more can be
+                     * submitted, and nothing in flight can be waited for
+                     */
+                    throw std::system_error( errno, std::generic_category(),
+                                             "io_uring_enter" );
+                }
+
+                auto head = *this->cqhead;
+                const auto end = __atomic_load_n( this->cqtail,
+                                                  __ATOMIC_ACQUIRE );
+                for( ; head != end; ++head, ++completed ) {
+                    const auto& cqe = this->cqes[ head & this->cqmask ];
+                    const auto i = std::size_t( cqe.user_data );
+                    if( cqe.res < 0 ) {
+                        if( !error ) error = -cqe.res;
+                        continue;
+                    }
+
+                    const auto got = std::size_t( cqe.res );
+                    if( got < size( i ) )
+                        rest.emplace_back( i * piece + got, size( i ) - got );
+                }
+                __atomic_store_n( this->cqhead, head, __ATOMIC_RELEASE );
+            }
+
+            if( error == EINVAL || error == EOPNOTSUPP ) return false;
+            if( error )
+                throw std::system_error( error, std::generic_category(), path );
+
+            for( const auto& x : rest )
+                readall( f, path, dst + x.first, x.second, x.first );
+
+            return true;
+        }
+
+    private:
+        static constexpr unsigned depth = 32;
+        static constexpr std::size_t piece = 1 << 20;
+
+        void teardown() {
+            if( this->cq && this->cq != this->sq && this->cq != MAP_FAILED )
+                ::munmap( this->cq, this->cqlen );
+            if( this->sq && this->sq != MAP_FAILED )
+                ::munmap( this->sq, this->sqlen );
+            if( this->fd >= 0 ) ::close( this->fd );
+
+            this->sq = this->cq = nullptr;
+            this->fd = -1;
+        }
+
+        int fd = -1;
+        void* sq = nullptr;
+        void* cq = nullptr;
+        std::size_t sqlen = 0, cqlen = 0, sqelen = 0;
+
+        unsigned* sqhead = nullptr;
+        unsigned* sqtail = nullptr;
+        unsigned* sqarray = nullptr;
+        unsigned sqmask = 0;
+        io_uring_sqe* sqes = nullptr;
+
+        unsigned* cqhead = nullptr;
+        unsigned* cqtail = nullptr;
+        unsigned cqmask = 0;
+        io_uring_cqe* cqes = nullptr;
+
+        unsigned entries = 0;
+};
+
+constexpr unsigned ring::depth;
+constexpr std::size_t ring::piece;
+
+/*
+ * Once the kernel has said it doesn't support reads through io_uring, don't
+ * bother asking again
+ */
+std::atomic< bool > uring_unsupported( false );
+
+std::shared_ptr< const source > readbuffered( const descriptor& f,
+                                              const fileid& id,
+                                              const std::string& path,
+                                              bool uring ) {
+    auto b = buffers().take( id.size );
+
+    bool done = false;
+    if( uring && id.size > 0 && !uring_unsupported ) {
+        thread_local ring r;
+        if( r.ok() ) done = r.read( f, path, b.data.get(), id.size );
+        if( !done ) uring_unsupported = true;
+    }
+
+    if( !done ) readall( f, path, b.data.get(), id.size );
+    return std::make_shared< const buffered >( id, std::move( b ) );
+}
+
+/*
+ * A compressed file, decompressed into memory. The identity is that of the
+ * compressed file, since that's what's on disk.
+ */
+class inflated : public source {
+    public:
+        inflated( const fileid& identity, std::vector< char > xs ) :
+            data( std::move( xs ) ) {
+            this->id = identity;
+            this->first = this->data.data();
+            this->last = this->first + this->data.size();
+        }
+
+    private:
+        std::vector< char > data;
+};
+
+enum class compression { none, gzip, zstd };
+
+compression detect( const source& src ) {
+    const auto magic = [&src]( std::initializer_list< unsigned char > m ) {
+        return src.size() >= m.size()
+            && std::equal( m.begin(), m.end(),
+                           reinterpret_cast< const unsigned char* >(
+                               src.begin() ) );
+    };
+
+    if( magic( { 0x1f, 0x8b } ) ) return compression::gzip;
+    if( magic( { 0x28, 0xb5, 0x2f, 0xfd } ) ) return compression::zstd;
+    return compression::none;
+}
+
+std::uint64_t little_endian( const char* p, std::size_t n ) {
+    std::uint64_t x = 0;
+    for( std::size_t i = n; i > 0; --i )
+        x = ( x << 8 ) | std::uint8_t( p[ i - 1 ] );
+    return x;
+}
+
+/*
+ * The decompressed size, as recorded by the compressor, or 0 if it's not
+ * known. It's only a hint, since gzip records the size of the last member
+ * modulo 4G, and zstd the size of the first frame, and only if the
+ * compressor knew it up front.
+ */
+std::size_t inflated_size( const source& src, compression kind ) {
+    const auto* p = src.begin();
+    const auto n = src.size();
+
+    switch( kind ) {
+        case compression::gzip:
+            /* the trailer ends with ISIZE, 4 bytes little endian */
+            return n >= 18 ? std::size_t( little_endian( p + n - 4, 4 ) ) : 0;
+
+        case compression::zstd: {
+            /*
+             * magic, frame header descriptor, the optional window descriptor
+             * and dictionary ID, and then the frame content size
+             */
+            if( n < 5 ) return 0;
+            const auto fhd = std::uint8_t( p[ 4 ] );
+            const bool single = fhd & 0x20;
+            const std::size_t dictsize[] = { 0, 1, 2, 4 };
+            const std::size_t fcssize[]  = { single ? 1u : 0u, 2, 4, 8 };
+            const auto fcs = fcssize[ fhd >> 6 ];
+            const auto at = 5 + ( single ? 0 : 1 ) + dictsize[ fhd & 3 ];
+            if( fcs == 0 || n < at + fcs ) return 0;
+
+            auto x = little_endian( p + at, fcs );
+            if( fcs == 2 ) x += 256;
+            return std::size_t( x );
+        }
+
+        case compression::none:
+            break;
+    }
+
+    return 0;
+}
+
+/*
+ * Compressed files are recognised by their magic bytes, regardless of name,
+ * and decompressed in memory, so that they can be included like any other
+ * file. The compressed input is released as soon as it's been decompressed.
+ */
+std::shared_ptr< const source > decompress( std::shared_ptr< const source > src,
+                                            compression kind,
+                                            const std::string& path ) {
+    namespace io = boost::iostreams;
+
+    io::filtering_istream in;
+    switch( kind ) {
+        case compression::gzip:
+            in.push( io::gzip_decompressor() );
+            break;
+
+        case compression::zstd:
+#ifdef HAVE_ZSTD
+            in.push( io::zstd_decompressor() );
+            break;
+#else
+            throw std::runtime_error( "Unable to read " + path
+                + ": zstd compressed, but built without zstd support" );
+#endif
+
+        case compression::none:
+            return src;
+    }
+
+    /*
+     * Decompress straight into a buffer of the recorded size, so that a
+     * well-formed file is a single allocation and no copies. When the size
+     * isn't known, or is wrong, guess generously (decks compress well) and
+     * grow geometrically. The buffer is never shrunk to fit, since that's
+     * another copy of the whole deck, with both alive at once.
+     */
+    const auto hint = inflated_size( *src, kind );
+    std::vector< char > out( hint > 0 ? hint : 4 * src->size() + 4096 );
+    std::size_t size = 0;
+
+    in.push( io::array_source( src->begin(), src->size() ) );
+    in.exceptions( std::ios::badbit );
+
+    try {
+        for( ;; ) {
+            if( size == out.size() ) {
+                /* it's only grown if there really is more */
+                if( in.peek() == std::char_traits< char >::eof() ) break;
+                out.resize( 2 * out.size() );
+            }
+
+            in.read( out.data() + size, std::streamsize( out.size() - size ) );
+            size += std::size_t( in.gcount() );
+            if( in.eof() ) break;
+        }
+    } catch( std::exception& e ) {
+        throw std::runtime_error( "Unable to decompress " + path
+                                + ": " + e.what() );
+    }
+
+    out.resize( size );
+    return std::make_shared< const inflated >( src->id, std::move( out ) );
+}
+
+std::shared_ptr< const source > read( const std::string& path, reader r ) {
+    const descriptor f( path );
+    const auto id = identify( f.fd, path );
+
+    switch( r ) {
+        case reader::mmap:
+            return std::make_shared< const mapped >( f, id, path, true );
+
+        case reader::pread:
+            return readbuffered( f, id, path, false );
+
+        case reader::uring:
+            return readbuffered( f, id, path, true );
+
+        case reader::automatic:
+            break;
+    }
+
+    if( id.size <= smallfile ) return readbuffered( f, id, path, false );
+    return std::make_shared< const mapped >( f, id, path, false );
+}
+
+reader fromenv() {
+    const char* env = std::getenv( "LUNAR_READER" );
+    if( !env ) return reader::automatic;
+
+    for( auto r : { reader::mmap, reader::pread, reader::uring } )
+        if( std::strcmp( env, reader_name( r ) ) == 0 ) return r;
+
+    return reader::automatic;
+}
+
+}
+
+const char* reader_name( reader r ) {
+    switch( r ) {
+        case reader::automatic: return "auto";
+        case reader::mmap:      return "mmap";
+        case reader::pread:     return "pread";
+        case reader::uring:     return "uring";
+    }
+
+    return "unknown";
+}
+
+std::shared_ptr< const source > load( const std::string& path, reader r ) {
+    static const auto env = fromenv();
+    if( r == reader::automatic ) r = env;
+
+    auto src = read( path, r );
+    const auto kind = detect( *src );
+    if( kind == compression::none ) return src;
+    return decompress( std::move( src ), kind, path );
+}
+
+}
@@ -0,0 +1,404 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#ifdef HAVE_X86_SIMD
+    #include <immintrin.h>
+#endif
+
+#include <lunar/search.hpp>
+
+#ifdef HAVE_BUILTIN_EXPECT
+    #define likely(cond)   __builtin_expect(static_cast<bool>((cond)), 1)
+    #define unlikely(cond) __builtin_expect(static_cast<bool>((cond)), 0)
+#else
+    #define likely(cond)   (cond)
+    #define unlikely(cond) (cond)
+#endif
+
+namespace lun {
+
+namespace {
+
+/*
+ * Check if fst is the start of a complete PATHS or INCLUDE keyword, and that
+ * it's the first non-blank thing on its line. Otherwise, it's either
+ * malformed or inside a comment.
+ *
+ * This is the slow path shared by all kernels, which should only be called
+ * for the (rare) positions that are likely candidates.
+ */
+inline bool keyword_at( const char* fst, const char* begin, const char* end ) {
+    static const char incl[]  = "INCLUDE";
+    static const char paths[] = "PATHS";
+
+    const char* kw;
+    std::size_t len;
+    switch( *fst ) {
+        case 'I': kw = incl;  len = sizeof( incl ) - 1;  break;
+        case 'P': kw = paths; len = sizeof( paths ) - 1; break;
+        default: return false;
+    }
+
+    if( std::size_t( end - fst ) < len ) return false;
+    if( std::memcmp( fst, kw, len ) != 0 ) return false;
+
+    /*
+     * definitely a match - now search backwards to determine if it's the
+     * first non-blank thing on this line. Reaching begin means start-of-file,
+     * i.e. no need to check if this a comment or dead
+     */
+    while( fst != begin ) {
+        const auto c = *--fst;
+        if( c == '\n' ) return true;
+        if( c != ' ' && c != '\t' ) return false;
+    }
+
+    return true;
+}
+
+/* check every position in [fst, end) - used for the tails of the kernels */
+inline const char* linear( const char* fst, const char* begin,
+                           const char* end ) {
+    for( ; fst < end; ++fst ) {
+        if( *fst != 'I' && *fst != 'P' ) continue;
+        if( keyword_at( fst, begin, end ) ) return fst;
+    }
+
+    return end;
+}
+
+const char* scalar( const char* begin, const char* end ) {
+    /*
+     * The scalar search function is essentially a static boyer-moore, adapted
+     * to work on *two* patterns.
+     *
+     * inspect every len(PATHS) character and check if it's possible it is a
+     * part of either PATHS or INCLUDE. If it's a match (rarely - norne is
+     * approx 450 000 lines and 26M large and contain between 50 and 60
+     * includes), rewind until the start of the word and simply check for a
+     * match with no magic.
+     *
+     * The stride must not be longer than the *shortest* pattern, or a PATHS
+     * could fit between two probes.
+     */
+    constexpr static const char
+        P = 0, A = 1, T = 2, H = 3, S = 4,
+        I = 0, N = 1, C = 2, L = 3, U = 4, D = 5, E = 6;
+
+    constexpr static const char rewinds[21] = {
+        A, 0, C, D, E, 0, 0, H,
+        I, 0, 0, L, 0, N, 0, P,
+        0, 0, S, T, U
+    };
+
+    constexpr std::ptrdiff_t stride = 5;
+    const std::ptrdiff_t size = end - begin;
+
+    /*
+     * The end-of-file check is *very* unlikely (once per file, they tend to be
+     * several megabytes) to ever be true, and some speed gains are measurable
+     * when marking it unlikely.
+     *
+     * The checking if this character is a substring match, however, is *also*
+     * very likely to be "false", i.e. not a match. This draws on the
+     * observation that *most* of the input file is integers or floats, not one
+     * of the 13 uppercase characters in PATHS and INCLUDE. In Norne, 0.6% of
+     * all characters in the input deck would match.
+     *
+     * The switch was measured to be slightly faster than a 256-byte lookup
+     * table and a std::bitset.
+     */
+    for( std::ptrdiff_t i = stride - 1; ; i += stride ) {
+        if( unlikely(i >= size) ) return end;
+
+        const auto c = begin[ i ];
+        switch( c ) {
+            case 'P':
+            case 'A':
+            case 'T':
+            case 'H':
+            case 'S':
+
+            case 'I':
+            case 'N':
+            case 'C':
+            case 'L':
+            case 'U':
+            case 'D':
+            case 'E':
+                break;
+
+            default:
+                continue;
+        }
+
+        /* matches a partial, search backwards */
+        const auto cur = i - rewinds[ c - 'A' ];
+        if( cur < 0 ) continue;
+        if( !keyword_at( begin + cur, begin, end ) ) continue;
+
+        return begin + cur;
+    }
+}
+
+#ifdef HAVE_X86_SIMD
+
+/*
+ * The vectorised kernels all do the same thing, with different widths:
+ *
+ * mark every byte that is either 'I' or 'P', *and* is preceded by a newline
+ * or a blank, which is a necessary condition for being the first thing on a
+ * line. Only those that pass are checked by keyword_at. The preceding
+ * characters come from an unaligned load, offset by one, which is why the
+ * first character of the buffer (which has no predecessor) is checked up
+ * front.
+ *
+ * Since numbers make up most of the input, practically every block is
+ * discarded after a few compares and a single branch.
+ */
+__attribute__((target("sse2")))
+const char* sse2( const char* begin, const char* end ) {
+    if( begin == end ) return end;
+    if( keyword_at( begin, begin, end ) ) return begin;
+
+    const auto I   = _mm_set1_epi8( 'I' );
+    const auto P   = _mm_set1_epi8( 'P' );
+    const auto NL  = _mm_set1_epi8( '\n' );
+    const auto SP  = _mm_set1_epi8( ' ' );
+    const auto TAB = _mm_set1_epi8( '\t' );
+
+    auto fst = begin + 1;
+    for( ; end - fst >= 16; fst += 16 ) {
+        const auto x = _mm_loadu_si128( (const __m128i*)fst );
+        const auto p = _mm_loadu_si128( (const __m128i*)(fst - 1) );
+
+        const auto kw = _mm_or_si128( _mm_cmpeq_epi8( x, I ),
+                                      _mm_cmpeq_epi8( x, P ) );
+        const auto ls = _mm_or_si128( _mm_cmpeq_epi8( p, NL ),
+                        _mm_or_si128( _mm_cmpeq_epi8( p, SP ),
+                                      _mm_cmpeq_epi8( p, TAB ) ) );
+
+        auto mask = unsigned( _mm_movemask_epi8( _mm_and_si128( kw, ls ) ) );
+        if( likely(mask == 0) ) continue;
+
+        for( ; mask; mask &= mask - 1 ) {
+            const auto cur = fst + __builtin_ctz( mask );
+            if( keyword_at( cur, begin, end ) ) return cur;
+        }
+    }
+
+    return linear( fst, begin, end );
+}
+
+__attribute__((target("avx2")))
+const char* avx2( const char* begin, const char* end ) {
+    if( begin == end ) return end;
+    if( keyword_at( begin, begin, end ) ) return begin;
+
+    const auto I   = _mm256_set1_epi8( 'I' );
+    const auto P   = _mm256_set1_epi8( 'P' );
+    const auto NL  = _mm256_set1_epi8( '\n' );
+    const auto SP  = _mm256_set1_epi8( ' ' );
+    const auto TAB = _mm256_set1_epi8( '\t' );
+
+    auto fst = begin + 1;
+    for( ; end - fst >= 32; fst += 32 ) {
+        const auto x = _mm256_loadu_si256( (const __m256i*)fst );
+        const auto p = _mm256_loadu_si256( (const __m256i*)(fst - 1) );
+
+        const auto kw = _mm256_or_si256( _mm256_cmpeq_epi8( x, I ),
+                                         _mm256_cmpeq_epi8( x, P ) );
+        const auto ls = _mm256_or_si256( _mm256_cmpeq_epi8( p, NL ),
+                        _mm256_or_si256( _mm256_cmpeq_epi8( p, SP ),
+                                         _mm256_cmpeq_epi8( p, TAB ) ) );
+
+        auto mask = std::uint32_t(
+            _mm256_movemask_epi8( _mm256_and_si256( kw, ls ) ) );
+        if( likely(mask == 0) ) continue;
+
+        for( ; mask; mask &= mask - 1 ) {
+            const auto cur = fst + __builtin_ctz( mask );
+            if( keyword_at( cur, begin, end ) ) return cur;
+        }
+    }
+
+    return linear( fst, begin, end );
+}
+
+__attribute__((target("avx512f,avx512bw")))
+const char* avx512( const char* begin, const char* end ) {
+    if( begin == end ) return end;
+    if( keyword_at( begin, begin, end ) ) return begin;
+
+    const auto I   = _mm512_set1_epi8( 'I' );
+    const auto P   = _mm512_set1_epi8( 'P' );
+    const auto NL  = _mm512_set1_epi8( '\n' );
+    const auto SP  = _mm512_set1_epi8( ' ' );
+    const auto TAB = _mm512_set1_epi8( '\t' );
+
+    auto fst = begin + 1;
+    for( ; end - fst >= 64; fst += 64 ) {
+        const auto x = _mm512_loadu_si512( fst );
+        const auto p = _mm512_loadu_si512( fst - 1 );
+
+        const auto kw = _mm512_cmpeq_epi8_mask( x, I )
+                      | _mm512_cmpeq_epi8_mask( x, P );
+        const auto ls = _mm512_cmpeq_epi8_mask( p, NL )
+                      | _mm512_cmpeq_epi8_mask( p, SP )
+                      | _mm512_cmpeq_epi8_mask( p, TAB );
+
+        auto mask = std::uint64_t( kw & ls );
+        if( likely(mask == 0) ) continue;
+
+        for( ; mask; mask &= mask - 1 ) {
+            const auto cur = fst + __builtin_ctzll( mask );
+            if( keyword_at( cur, begin, end ) ) return cur;
+        }
+    }
+
+    return linear( fst, begin, end );
+}
+
+/*
+ * Counting newlines is much simpler - compare, and popcount the mask. The
+ * count is accumulated in a plain integer, since the mask has to be moved
+ * out of the vector register for the (rare) keyword checks in search anyway,
+ * and the loop is bound by memory bandwidth regardless.
+ */
+__attribute__((target("sse2,popcnt")))
+std::size_t count_sse2( const char* fst, const char* lst ) {
+    const auto NL = _mm_set1_epi8( '\n' );
+    std::size_t n = 0;
+
+    for( ; lst - fst >= 16; fst += 16 ) {
+        const auto x = _mm_loadu_si128( (const __m128i*)fst );
+        n += __builtin_popcount( _mm_movemask_epi8( _mm_cmpeq_epi8( x, NL ) ) );
+    }
+
+    return n + std::count( fst, lst, '\n' );
+}
+
+__attribute__((target("avx2,popcnt")))
+std::size_t count_avx2( const char* fst, const char* lst ) {
+    const auto NL = _mm256_set1_epi8( '\n' );
+    std::size_t n = 0;
+
+    for( ; lst - fst >= 32; fst += 32 ) {
+        const auto x = _mm256_loadu_si256( (const __m256i*)fst );
+        const auto m = _mm256_movemask_epi8( _mm256_cmpeq_epi8( x, NL ) );
+        n += __builtin_popcount( std::uint32_t( m ) );
+    }
+
+    return n + std::count( fst, lst, '\n' );
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt")))
+std::size_t count_avx512( const char* fst, const char* lst ) {
+    const auto NL = _mm512_set1_epi8( '\n' );
+    std::size_t n = 0;
+
+    for( ; lst - fst >= 64; fst += 64 ) {
+        const auto x = _mm512_loadu_si512( fst );
+        n += __builtin_popcountll( _mm512_cmpeq_epi8_mask( x, NL ) );
+    }
+
+    return n + std::count( fst, lst, '\n' );
+}
+
+#endif // HAVE_X86_SIMD
+
+std::size_t count_scalar( const char* fst, const char* lst ) {
+    return std::count( fst, lst, '\n' );
+}
+
+kernel preferred() {
+    const kernel preference[] = {
+        kernel::avx512, kernel::avx2, kernel::sse2, kernel::scalar,
+    };
+
+    const char* env = std::getenv( "LUNAR_SEARCH" );
+    if( env ) {
+        for( auto k : preference ) {
+            if( std::strcmp( env, kernel_name( k ) ) != 0 ) continue;
+            if( search_kernel( k ) ) return k;
+        }
+    }
+
+    for( auto k : preference )
+        if( search_kernel( k ) ) return k;
+
+    return kernel::scalar;
+}
+
+}
+
+searchfn search_kernel( kernel k ) {
+    switch( k ) {
+        case kernel::scalar:
+            return scalar;
+
+#ifdef HAVE_X86_SIMD
+        case kernel::sse2:
+            return __builtin_cpu_supports( "sse2" ) ? sse2 : nullptr;
+
+        case kernel::avx2:
+            return __builtin_cpu_supports( "avx2" ) ? avx2 : nullptr;
+
+        case kernel::avx512:
+            return __builtin_cpu_supports( "avx512f" )
+                && __builtin_cpu_supports( "avx512bw" ) ? avx512 : nullptr;
+#endif
+
+        default:
+            return nullptr;
+    }
+}
+
+const char* kernel_name( kernel k ) {
+    switch( k ) {
+        case kernel::scalar: return "scalar";
+        case kernel::sse2:   return "sse2";
+        case kernel::avx2:   return "avx2";
+        case kernel::avx512: return "avx512";
+    }
+
+    return "unknown";
+}
+
+countfn newline_kernel( kernel k ) {
+    if( !search_kernel( k ) ) return nullptr;
+
+#ifdef HAVE_X86_SIMD
+    /*
+     * the counters are compiled for popcnt too, which isn't implied by any of
+     * the vector extensions (early sse2 machines don't have it), so without
+     * it the count is scalar, even when the search kernel is not
+     */
+    if( !__builtin_cpu_supports( "popcnt" ) ) return count_scalar;
+#endif
+
+    switch( k ) {
+#ifdef HAVE_X86_SIMD
+        case kernel::sse2:   return count_sse2;
+        case kernel::avx2:   return count_avx2;
+        case kernel::avx512: return count_avx512;
+#endif
+        default:             return count_scalar;
+    }
+}
+
+const char* search( const char* begin, const char* end ) {
+    static const auto fn = search_kernel( preferred() );
+    return fn( begin, end );
+}
+
+std::size_t newlines( const char* fst, const char* lst ) {
+    static const auto fn = newline_kernel( preferred() );
+    return fn( fst, lst );
+}
+
+}
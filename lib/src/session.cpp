@@ -0,0 +1,214 @@
+#include <cerrno>
+#include <chrono>
+#include <set>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <filesystem/path.h>
+
+#include <lunar/cache.hpp>
+#include <lunar/incremental.hpp>
+
+#include <lunar/parser.hpp>
+
+namespace lun {
+
+namespace {
+
+/* a file that can't be stat'd any more has changed, but isn't an error */
+fileid identify_or_gone( const std::string& path ) {
+    try {
+        return identify( path );
+    } catch( const std::system_error& ) {
+        return fileid();
+    }
+}
+
+std::string directory( const std::string& path ) {
+    const auto dir = filesystem::path( path ).parent_path().str();
+    return dir.empty() ? "." : dir;
+}
+
+}
+
+struct session::impl {
+    impl( const std::string& r, const concatopts& o ) :
+        root( r ),
+        opts( o ),
+        deck( concatenate( r, o ) )
+    {
+        this->identify();
+        const auto& in = this->deck.inlined;
+        this->parsed = track( in.data(), in.data() + in.size() );
+        this->reparsed = this->parsed.kws.size();
+    }
+
+    ~impl() {
+        if( this->inotify >= 0 ) ::close( this->inotify );
+    }
+
+    void identify() {
+        this->ids.clear();
+        for( const auto& path : this->deck.included )
+            this->ids.push_back( identify_or_gone( path ) );
+    }
+
+    bool changed() const {
+        for( std::size_t i = 0; i < this->ids.size(); ++i ) {
+            if( identify_or_gone( this->deck.included[ i ] ) != this->ids[ i ] )
+                return true;
+        }
+        return false;
+    }
+
+    bool refresh();
+
+    void listen();
+    bool wait( int timeout_ms );
+
+    std::string root;
+    concatopts opts;
+    lun::inlined deck;
+    std::vector< fileid > ids;
+    tracked parsed;
+    std::size_t reparsed = 0;
+
+    int inotify = -1;
+    std::set< std::string > watched;
+};
+
+bool session::impl::refresh() {
+    if( !this->changed() ) return false;
+
+    /*
+     * only reading the deck can fail, and it's done before anything is
+     * changed, so that the session is left as it was
+     */
+    auto next = concatenate( this->root, this->opts );
+    const auto& old = this->deck.inlined;
+    const auto& in = next.inlined;
+    this->reparsed = retrack( this->parsed,
+                              old.data(), old.data() + old.size(),
+                              in.data(), in.data() + in.size() );
+
+    this->deck = std::move( next );
+    this->identify();
+    return true;
+}
+
+/*
+ * Watch the directories of the included files, rather than the files. Most
+ * editors save by writing a new file and renaming it over the old one, which
+ * a watch on the file itself would never see.
+ */
+void session::impl::listen() {
+    if( this->inotify < 0 ) {
+        this->inotify = ::inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+        if( this->inotify < 0 )
+            throw std::system_error( errno, std::generic_category(), "inotify" );
+    }
+
+    const auto mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE
+                    | IN_ATTRIB | IN_DELETE | IN_MOVED_FROM;
+
+    for( const auto& path : this->deck.included ) {
+        const auto dir = directory( path );
+        if( this->watched.count( dir ) ) continue;
+
+        /* the directory can be gone, and then a missing file is a change */
+        if( ::inotify_add_watch( this->inotify, dir.c_str(), mask ) >= 0 )
+            this->watched.insert( dir );
+    }
+}
+
+/* wait for, and drain, events - returns false on timeout */
+bool session::impl::wait( int timeout_ms ) {
+    pollfd fd = { this->inotify, POLLIN, 0 };
+    int ready;
+    do {
+        ready = ::poll( &fd, 1, timeout_ms );
+    } while( ready < 0 && errno == EINTR );
+
+    if( ready < 0 )
+        throw std::system_error( errno, std::generic_category(), "poll" );
+
+    if( ready == 0 ) return false;
+
+    alignas( inotify_event ) char buffer[ 4096 ];
+    while( ::read( this->inotify, buffer, sizeof( buffer ) ) > 0 )
+        ;
+    return true;
+}
+
+session::session( const std::string& root, const concatopts& opts ) :
+    p( new impl( root, opts ) )
+{}
+
+session::~session() = default;
+session::session( session&& ) noexcept = default;
+session& session::operator=( session&& ) noexcept = default;
+
+const lun::inlined& session::inlined() const {
+    return this->p->deck;
+}
+
+const std::vector< keyword >& session::keywords() const {
+    return this->p->parsed.kws;
+}
+
+bool session::complete() const {
+    return this->p->parsed.complete;
+}
+
+bool session::refresh() {
+    return this->p->refresh();
+}
+
+bool session::watch( int timeout_ms ) {
+    auto& self = *this->p;
+    const auto first = self.inotify < 0;
+    self.listen();
+
+    /*
+     * the files may have changed before they were first watched, but after
+     * that, every change is an event
+     */
+    if( first && self.refresh() ) {
+        self.listen();
+        return true;
+    }
+
+    /*
+     * events in the directories are not necessarily for the deck's files, so
+     * keep waiting until one of them really changed, or the time is up
+     */
+    const auto start = std::chrono::steady_clock::now();
+    auto left = timeout_ms;
+    for( ;; ) {
+        if( !self.wait( left ) ) return false;
+
+        if( self.refresh() ) {
+            self.listen();
+            return true;
+        }
+
+        if( timeout_ms < 0 ) continue;
+        const auto elapsed = std::chrono::duration_cast< std::chrono::milliseconds >(
+            std::chrono::steady_clock::now() - start
+        ).count();
+        if( elapsed >= timeout_ms ) return false;
+        left = int( timeout_ms - elapsed );
+    }
+}
+
+std::size_t session::reparsed() const {
+    return this->p->reparsed;
+}
+
+}
@@ -1,9 +1,13 @@
 #include <algorithm>
+#include <cstring>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <type_traits>
+#include <vector>
 
 #include <lunar/parser.hpp>
+#include <lunar/lexer.hpp>
 
 #include <catch/catch.hpp>
 
@@ -12,7 +16,7 @@ namespace Catch {
 template<>
 struct StringMaker< lun::keyword > {
     static std::string convert( const lun::keyword& kw ) {
-        return kw.name;
+        return kw.name.to_string();
     }
 };
 
@@ -100,10 +104,16 @@ const lun::keyword& get( const std::string& key,
     return *itr;
 }
 
+}
+
 /*
  * implement operator== for item so that tests can be written as item == 10
  * (int), item == "STRING" or item == Approx(1.5)
+ *
+ * they live in namespace lun so that argument-dependent lookup finds them
+ * from inside catch's comparison templates
  */
+namespace lun {
 
 template< typename T >
 bool operator==( const lun::item& lhs, T rhs ) {
@@ -433,3 +443,204 @@ GRIDOPTS
         CHECK( x == "YES" );
     }
 }
+
+TEST_CASE( "any contiguous buffer can be parsed", "[parse]" ) {
+    const std::string input = "RUNSPEC\n"
+                              "DIMENS\n"
+                              "    10 10 3 /\n"
+                              "GRIDOPTS\n"
+                              "    'YES' /\n"
+                              "GRID\n"
+                              ;
+
+    const auto expected = lun::parse( input.begin(), input.end() );
+    REQUIRE( expected.size() == 4 );
+
+    const auto show = []( const std::vector< lun::item >& xs ) {
+        std::ostringstream stream;
+        for( const auto& x : xs ) stream << x;
+        return stream.str();
+    };
+
+    const auto* fst = input.data();
+    const auto* lst = fst + input.size();
+    const std::vector< char > buffer( fst, lst );
+
+    const std::vector< std::vector< lun::keyword > > parsed = {
+        lun::parse( fst, lst ),
+        lun::parse( input ),
+        lun::parse( buffer ),
+    };
+
+    for( const auto& sec : parsed ) {
+        REQUIRE( sec.size() == expected.size() );
+        for( std::size_t i = 0; i < sec.size(); ++i ) {
+            CHECK( sec[ i ].name == expected[ i ].name );
+            CHECK( show( sec[ i ].xs ) == show( expected[ i ].xs ) );
+        }
+    }
+
+    SECTION( "the range is not read past its end" ) {
+        /* the buffer goes on, but the range stops after DIMENS */
+        const auto end = input.find( "GRIDOPTS" );
+        const auto sec = lun::parse( fst, fst + end );
+        REQUIRE( sec.size() == 2 );
+        CHECK( sec.back().name == "DIMENS" );
+    }
+
+    SECTION( "empty ranges are empty decks" ) {
+        CHECK( lun::parse( fst, fst ).empty() );
+        CHECK( lun::parse( std::string() ).empty() );
+    }
+}
+
+TEST_CASE( "defaults and repeats", "[repeat]" ) {
+    const std::string input = R"(
+GRID
+MAPAXES
+    * 3* 2*1.5 1.e3 1d-2 /
+TRACERS
+    1 2.5 3*0.5 'x' 2* /
+)";
+
+    auto sec = lun::parse( input );
+    REQUIRE( sec.size() == 3 );
+
+    SECTION( "* and N* are defaults" ) {
+        const auto& xs = sec.at( 1 ).xs;
+        REQUIRE( xs.size() == 6 );
+
+        CHECK_THAT( xs[ 0 ], Repeats( 0 ) );
+        CHECK_THAT( xs[ 0 ], IsType< lun::item::none >() );
+        CHECK_THAT( xs[ 1 ], Repeats( 3 ) );
+        CHECK_THAT( xs[ 1 ], IsType< lun::item::none >() );
+
+        CHECK_THAT( xs[ 2 ], Repeats( 2 ) );
+        CHECK( xs[ 2 ] == Approx( 1.5 ) );
+        CHECK( xs[ 3 ] == Approx( 1000 ) );
+        CHECK( xs[ 4 ] == Approx( 0.01 ) );
+    }
+
+    SECTION( "mixed records keep doubles whole" ) {
+        const auto& xs = sec.at( 2 ).xs;
+        REQUIRE( xs.size() == 6 );
+
+        CHECK( xs[ 0 ] == 1 );
+        REQUIRE_THAT( xs[ 1 ], IsFloat() );
+        CHECK( xs[ 1 ] == Approx( 2.5 ) );
+        CHECK_THAT( xs[ 2 ], Repeats( 3 ) );
+        CHECK( xs[ 2 ] == Approx( 0.5 ) );
+        CHECK( xs[ 3 ] == "x" );
+        CHECK_THAT( xs[ 4 ], Repeats( 2 ) );
+        CHECK_THAT( xs[ 4 ], IsType< lun::item::none >() );
+        CHECK_THAT( xs[ 5 ], IsEnd() );
+    }
+}
+
+TEST_CASE( "grid arrays have the items of records", "[array]" ) {
+    std::string large;
+    for( int i = 0; i < 3000; ++i )
+        large += i % 7 == 0 ? " 3*" + std::to_string( i ) + ".5"
+                            : " " + std::to_string( i );
+
+    const std::vector< std::string > bodies = {
+        " /",
+        " 1 2.5 3*0.25 1D2 -4e-1 /",
+        " * 2* 1 4*2 3*\n -- comment\n 5 / tail",
+        large + " /",
+        large + " 2.5* /",
+        " 1 2 'x' /",
+        " 1 2 3.*4 /",
+        " 1 2 3",
+    };
+
+    const auto show = []( const std::vector< lun::keyword >& kws ) {
+        std::ostringstream stream;
+        for( const auto& kw : kws ) {
+            stream << kw.name << ":";
+            for( const auto& x : kw.xs ) stream << x << x.repeat;
+            stream << "\n";
+        }
+        return stream.str();
+    };
+
+    const auto records = [&]( const std::string& name, const std::string& s ) {
+        auto out = show( lun::parse( "GRID\n" + name + "\n" + s + "\n" ) );
+        return out.substr( std::min( out.find( name ), out.size() ) );
+    };
+
+    for( const auto& body : bodies ) {
+        INFO( body );
+        const auto expected = records( "MAPAXES", body );
+        for( const auto* kw : { "COORD", "ZCORN", "PORO", "PERMX" } ) {
+            INFO( kw );
+            auto got = records( kw, body );
+            if( !got.empty() ) got.replace( 0, std::strlen( kw ), "MAPAXES" );
+            CHECK( got == expected );
+        }
+
+        auto actnum = records( "ACTNUM", body );
+        if( !actnum.empty() ) actnum.replace( 0, 6, "GRIDFILE" );
+        CHECK( actnum == records( "GRIDFILE", body ) );
+    }
+
+    SECTION( "the values of an array are contiguous in a deck" ) {
+        const auto deck = lun::tabulate( "ZCORN\n" + large + " /\n" );
+        REQUIRE( deck.size() == 1 );
+        CHECK( deck[ 0 ].doubles().size() == 3000 );
+        CHECK( deck[ 0 ].values() == 3000 + 2 * 429 );
+    }
+}
+
+TEST_CASE( "blanks and comments are skipped", "[skip]" ) {
+    /* the old skipper, a character at a time */
+    const auto reference = []( const char* fst, const char* lst ) {
+        for( ;; ) {
+            while( fst != lst && std::strchr( " \t\n\v\f\r", *fst ) && *fst )
+                ++fst;
+            if( lst - fst < 2 || fst[ 0 ] != '-' || fst[ 1 ] != '-' )
+                return fst;
+            fst += 2;
+            while( fst != lst && *fst != '\n' && *fst != '\r' ) ++fst;
+        }
+    };
+
+    const std::string blanks = " \t\n\v\f\r";
+    std::vector< std::string > inputs = {
+        "",
+        "-",
+        "--",
+        "- 1",
+        "-- comment",
+        "-- comment\r1",
+        "-- comment\r\n1",
+        "-- a\n\n   -- b\n--\n-1",
+        "--\n--\n--\n/",
+    };
+
+    /* runs of every length, ending anywhere in a block, before a comment */
+    for( std::size_t n = 0; n < 40; ++n ) {
+        std::string run;
+        for( std::size_t i = 0; i < n; ++i ) run += blanks[ i % blanks.size() ];
+        inputs.push_back( run );
+        inputs.push_back( run + "1" );
+        inputs.push_back( run + "-- comment\n" + run + "x" );
+    }
+
+    for( const auto& input : inputs ) {
+        INFO( input );
+        const auto* fst = input.data();
+        const auto* lst = fst + input.size();
+        CHECK( lun::skipws( fst, lst ) - fst == reference( fst, lst ) - fst );
+    }
+
+    const std::string paths = "PATHS  -- banner\n"
+                              "-----------------\n"
+                              "\t\t 'A'   'a'  /  -- alias\n"
+                              "\r\n 'B' \"b\" /\n/\n";
+    const auto* fst = paths.data();
+    const auto xs = lun::PATHS( fst, paths.data() + paths.size() );
+    REQUIRE( xs.size() == 2 );
+    CHECK( xs[ 0 ].first == "A" );
+    CHECK( xs[ 1 ].second == "b" );
+}
@@ -0,0 +1,259 @@
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <lunar/parser.hpp>
+
+#include <catch/catch.hpp>
+
+namespace {
+
+template< typename T >
+std::string str( const T& x ) {
+    return std::string( std::begin( x ), std::end( x ) );
+}
+
+std::string tempdir() {
+    char tmpl[] = "/tmp/lunar-cache-XXXXXX";
+    return mkdtemp( tmpl );
+}
+
+void write( const std::string& path, const std::string& contents ) {
+    std::ofstream fs( path, std::ios::trunc );
+    fs << contents;
+}
+
+std::string read( const std::string& path ) {
+    std::ifstream fs( path, std::ios::binary );
+    return std::string( std::istreambuf_iterator< char >( fs ), {} );
+}
+
+std::vector< std::string > entries( const std::string& dir ) {
+    std::vector< std::string > xs;
+    auto* d = opendir( dir.c_str() );
+    while( auto* e = readdir( d ) )
+        if( e->d_name[ 0 ] != '.' ) xs.push_back( dir + "/" + e->d_name );
+    closedir( d );
+    return xs;
+}
+
+std::string show( const lun::deck& deck ) {
+    std::ostringstream stream;
+    for( const auto& kw : deck.keywords() ) {
+        stream << kw.name << ":";
+        for( const auto& x : kw.xs ) stream << x << x.repeat;
+        stream << "\n";
+    }
+    return stream.str();
+}
+
+}
+
+TEST_CASE( "concatenate output is cached", "[cache]" ) {
+    using Catch::Matchers::Equals;
+
+    const auto dir = tempdir();
+    const auto cachedir = tempdir();
+    mkdir( ( dir + "/sub" ).c_str(), 0700 );
+
+    const auto root = dir + "/root.data";
+    const auto inc = dir + "/sub/a.inc";
+    write( root, "RUNSPEC\n"
+                 "PATHS\n 'SUB' 'sub' /\n/\n"
+                 "INCLUDE\n '$SUB/a.inc' /\n"
+                 "GRID\n" );
+    write( inc, "included\n" );
+
+    int opens = 0;
+    lun::concatopts opts;
+    opts.cache = cachedir;
+    opts.before_open = [&opens]( const std::string& ) { ++opens; };
+
+    const auto first = lun::concatenate( root, opts );
+    CHECK_THAT( str( first.inlined ), Equals( "RUNSPEC\nincluded\nGRID\n" ) );
+    CHECK( opens == 2 );
+
+    SECTION( "a hit does not open any input" ) {
+        opens = 0;
+        const auto second = lun::splice( root, opts );
+        CHECK( opens == 0 );
+        CHECK_THAT( str( second.inlined ), Equals( str( first.inlined ) ) );
+        CHECK( second.included == first.included );
+        CHECK( second.inlined.chunks().size() == 1 );
+    }
+
+    SECTION( "a hit can be streamed" ) {
+        opens = 0;
+        std::ostringstream stream;
+        const auto included = lun::concatenate( root, stream, 4, opts );
+        CHECK( opens == 0 );
+        CHECK_THAT( stream.str(), Equals( str( first.inlined ) ) );
+        CHECK( included == first.included );
+    }
+
+    SECTION( "changing an included file invalidates the entry" ) {
+        write( inc, "changed\n" );
+
+        opens = 0;
+        const auto second = lun::concatenate( root, opts );
+        CHECK( opens == 2 );
+        CHECK_THAT( str( second.inlined ),
+                    Equals( "RUNSPEC\nchanged\nGRID\n" ) );
+
+        opens = 0;
+        const auto third = lun::concatenate( root, opts );
+        CHECK( opens == 0 );
+        CHECK_THAT( str( third.inlined ), Equals( str( second.inlined ) ) );
+    }
+
+    SECTION( "replacing an included file invalidates the entry" ) {
+        /*
+         * same size, and possibly the same mtime, but a different inode
+         */
+        const auto tmp = dir + "/sub/replacement";
+        write( tmp, "replaced\n" );
+        REQUIRE( rename( tmp.c_str(), inc.c_str() ) == 0 );
+
+        opens = 0;
+        const auto second = lun::concatenate( root, opts );
+        CHECK( opens == 2 );
+        CHECK_THAT( str( second.inlined ),
+                    Equals( "RUNSPEC\nreplaced\nGRID\n" ) );
+    }
+
+    SECTION( "the source map is cached" ) {
+        lun::concatopts mapped = opts;
+        mapped.sourcemap = true;
+
+        /* the entry has no map, so this is a miss */
+        opens = 0;
+        const auto second = lun::concatenate( root, mapped );
+        CHECK( opens == 2 );
+        CHECK( !second.map.intervals.empty() );
+
+        opens = 0;
+        const auto third = lun::concatenate( root, mapped );
+        CHECK( opens == 0 );
+        REQUIRE( third.map.intervals.size() == second.map.intervals.size() );
+        CHECK( third.map.size == second.map.size );
+
+        const auto loc = third.map.locate( 8, third.inlined.data() );
+        CHECK( loc.file == 1 );
+        CHECK( loc.line == 1 );
+    }
+
+    SECTION( "a removed include is a miss, and reported as an error" ) {
+        unlink( inc.c_str() );
+        CHECK_THROWS( lun::concatenate( root, opts ) );
+    }
+
+    SECTION( "a streaming miss populates the cache" ) {
+        write( inc, "streamed\n" );
+
+        std::ostringstream stream;
+        lun::concatenate( root, stream, 4, opts );
+        CHECK_THAT( stream.str(), Equals( "RUNSPEC\nstreamed\nGRID\n" ) );
+
+        opens = 0;
+        const auto second = lun::concatenate( root, opts );
+        CHECK( opens == 0 );
+        CHECK_THAT( str( second.inlined ), Equals( stream.str() ) );
+    }
+
+    unlink( inc.c_str() );
+    unlink( root.c_str() );
+    rmdir( ( dir + "/sub" ).c_str() );
+    rmdir( dir.c_str() );
+    const auto cleanup = "rm -rf '" + cachedir + "'";
+    CHECK( std::system( cleanup.c_str() ) == 0 );
+}
+
+TEST_CASE( "tabulated decks are cached", "[cache]" ) {
+    const auto cachedir = tempdir();
+    const std::string input = "RUNSPEC\n"
+                              "DIMENS\n 10 20 30 /\n"
+                              "GRIDOPTS\n 'YES' 2* /\n"
+                              "MAPAXES\n 0.5 1.5 3*2.5 /\n"
+                              ;
+
+    lun::tabulateopts opts;
+    opts.cache = cachedir;
+
+    const auto expected = show( lun::tabulate( input ) );
+    const auto first = lun::tabulate( input, opts );
+    CHECK( show( first ) == expected );
+    REQUIRE( entries( cachedir ).size() == 1 );
+    const auto entry = entries( cachedir ).front();
+
+    SECTION( "a hit is the same deck" ) {
+        const auto second = lun::tabulate( input, opts );
+        CHECK( show( second ) == expected );
+        CHECK( second.data().tags.size() == first.data().tags.size() );
+    }
+
+    SECTION( "a changed entry is a miss" ) {
+        auto contents = read( entry );
+        const double x = 1.5;
+        const double y = 7.5;
+        const auto pos = contents.find( std::string(
+            reinterpret_cast< const char* >( &x ), sizeof( x ) ) );
+        REQUIRE( pos != std::string::npos );
+        std::memcpy( &contents[ pos ], &y, sizeof( y ) );
+        write( entry, contents );
+
+        const auto second = lun::tabulate( input, opts );
+        const auto doubles = second[ 3 ].doubles();
+        REQUIRE( doubles.size() == 3 );
+        CHECK( doubles.begin()[ 1 ] == 1.5 );
+    }
+
+    SECTION( "an entry with offsets out of the columns is a miss" ) {
+        /*
+         * the offsets of the first record, all 0, are made to point far
+         * outside of the columns, which the sentinels at the end don't catch
+         */
+        auto contents = read( entry );
+        const std::size_t zeros[ 5 ] = {};
+        const auto pos = contents.find( std::string(
+            reinterpret_cast< const char* >( zeros ), sizeof( zeros ) ) );
+        REQUIRE( pos != std::string::npos );
+        const std::size_t far = 1 << 30;
+        std::memcpy( &contents[ pos ], &far, sizeof( far ) );
+        write( entry, contents );
+
+        CHECK( show( lun::tabulate( input, opts ) ) == expected );
+    }
+
+    SECTION( "other input is another entry" ) {
+        const auto other = input + "GRID\n";
+        lun::tabulate( other, opts );
+        CHECK( entries( cachedir ).size() == 2 );
+        CHECK( lun::tabulate( other, opts ).size() == 5 );
+    }
+
+    SECTION( "broken entries are misses" ) {
+        const auto contents = read( entry );
+        for( const auto size : { std::size_t( 0 ), std::size_t( 100 ),
+                                 contents.size() - 1 } ) {
+            INFO( size );
+            write( entry, contents.substr( 0, size ) );
+            CHECK( show( lun::tabulate( input, opts ) ) == expected );
+        }
+    }
+
+    SECTION( "decks that could not be parsed are not stored" ) {
+        lun::tabulate( input + "UNKNOWN\n", opts );
+        CHECK( entries( cachedir ).size() == 1 );
+    }
+
+    const auto cleanup = "rm -rf '" + cachedir + "'";
+    CHECK( std::system( cleanup.c_str() ) == 0 );
+}
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <lunar/column.hpp>
+#include <lunar/parser.hpp>
+
+#include <catch/catch.hpp>
+
+namespace {
+
+std::string show( const std::vector< lun::keyword >& kws ) {
+    std::ostringstream stream;
+    for( const auto& kw : kws ) {
+        stream << kw.name << ":";
+        for( const auto& x : kw.xs ) stream << x << x.repeat;
+        stream << "\n";
+    }
+    return stream.str();
+}
+
+template< typename T >
+std::vector< T > vec( lun::span< const T > xs ) {
+    return std::vector< T >( xs.begin(), xs.end() );
+}
+
+}
+
+TEST_CASE( "a deck has the same items as parse()", "[deck]" ) {
+    const std::vector< std::string > inputs = {
+        "",
+        "RUNSPEC\nOIL\nWATER\n",
+        "DIMENS\n 10 20 30 /\n",
+        "DIMENS\n 10 2* /\nEQLDIMS\n * 1 3* 5 /\n",
+        "GRIDOPTS\n 'YES' 2* /\nEQLOPTS\n 'A' \"B\" C1 /\n",
+        "TRACERS\n 1 2.5 'x' 3*4 2*1.5D2 -- comment\n 4* /\n",
+        "MAPAXES\n 0.0 1.5 1D2 -2.5e-3 3*0.25 /\nGRID\nNEWTRAN\n",
+        "DIMENS\n 1 2 3 /\nMAPAXES\n 1.0 'x' /\n",
+    };
+
+    for( const auto& input : inputs ) {
+        INFO( input );
+        const auto deck = lun::tabulate( input );
+        CHECK( show( deck.keywords() ) == show( lun::parse( input ) ) );
+    }
+}
+
+TEST_CASE( "values are stored by type", "[deck]" ) {
+    const auto deck = lun::tabulate(
+        "DIMENS\n 10 20 30 /\n"
+        "GRIDOPTS\n 'YES' 2* /\n"
+        "MAPAXES\n 0.5 1.5 2.5 /\n"
+    );
+
+    REQUIRE( deck.size() == 3 );
+    CHECK( deck[ 0 ].name() == "DIMENS" );
+    CHECK( deck[ 1 ].name() == "GRIDOPTS" );
+    CHECK( deck[ 2 ].name() == "MAPAXES" );
+
+    CHECK( vec( deck[ 0 ].ints() ) == std::vector< int >{ 10, 20, 30 } );
+    CHECK( deck[ 0 ].doubles().empty() );
+    CHECK( deck[ 1 ].ints().empty() );
+    CHECK( vec( deck[ 2 ].doubles() ) == std::vector< double >{ 0.5, 1.5, 2.5 } );
+
+    const auto& cols = deck.data();
+    CHECK( cols.tags.size() == 4 + 3 + 4 );
+    CHECK( cols.ints.size() == 3 );
+    CHECK( cols.doubles.size() == 3 );
+    CHECK( std::string( cols.pool.begin(), cols.pool.end() ) == "YES" );
+}
+
+TEST_CASE( "only N* repeats are stored", "[deck]" ) {
+    const auto deck = lun::tabulate( "EQLDIMS\n 1 3*5 * 2* 7 /\n" );
+    const auto kw = deck[ 0 ];
+
+    CHECK( vec( deck.data().repeats ) == std::vector< int >{ 3, 2 } );
+
+    std::vector< int > repeats;
+    std::vector< lun::deck::type > types;
+    for( auto itr = kw.begin(); itr != kw.end(); ++itr ) {
+        repeats.push_back( itr.repeat() );
+        types.push_back( itr.type() );
+    }
+
+    using type = lun::deck::type;
+    CHECK( repeats == std::vector< int >{ 0, 3, 0, 2, 0, 0 } );
+    CHECK( types == std::vector< type >{
+        type::integer,
+        type::integer,
+        type::none,
+        type::none,
+        type::integer,
+        type::endrec,
+    });
+}
+
+TEST_CASE( "records are found without walking items", "[deck]" ) {
+    const auto deck = lun::tabulate(
+        "RUNSPEC\n"
+        "DIMENS\n 10 20 30 /\n"
+        "MAPAXES\n 0.5 1.5 /\n"
+    );
+
+    const auto runspec = deck[ 0 ];
+    CHECK( runspec.records() == 0 );
+    CHECK( runspec.empty() );
+
+    const auto mapaxes = deck[ 2 ];
+    REQUIRE( mapaxes.records() == 1 );
+    const auto rec = mapaxes.record( 0 );
+    CHECK( rec.size() == 3 );
+    CHECK( vec( rec.doubles() ) == std::vector< double >{ 0.5, 1.5 } );
+    CHECK( rec.doubles().begin() == deck.data().doubles.begin() );
+}
+
+TEST_CASE( "keywords that fail are not in the deck", "[deck]" ) {
+    const std::string input = "DIMENS\n 10 20 30 /\nMAPAXES\n 1.0 'x' /\n";
+    const auto deck = lun::tabulate( input );
+
+    REQUIRE( deck.size() == 1 );
+    CHECK( deck[ 0 ].name() == "DIMENS" );
+
+    const auto& cols = deck.data();
+    CHECK( cols.doubles.empty() );
+    CHECK( cols.pool.empty() );
+    CHECK( cols.tags.size() == 4 );
+}
+
+TEST_CASE( "an empty deck has no keywords", "[deck]" ) {
+    CHECK( lun::deck().empty() );
+    CHECK( lun::deck().keywords().empty() );
+    CHECK( lun::tabulate( std::string() ).empty() );
+}
+
+TEST_CASE( "repeats are runs, and expanded on demand", "[deck]" ) {
+    const auto deck = lun::tabulate(
+        "MAPAXES\n 1000000*0.25 1.5 2.5 2*3.0 2* /\n"
+        "EQLDIMS\n 3*5 * 2 /\n"
+    );
+
+    const auto mapaxes = deck[ 0 ];
+    const auto eqldims = deck[ 1 ];
+
+    /* only the runs are stored */
+    CHECK( mapaxes.doubles().size() == 4 );
+    CHECK( mapaxes.values() == 1000006 );
+    CHECK( eqldims.values() == 5 );
+
+    SECTION( "expanded lazily" ) {
+        std::vector< int > xs;
+        for( const auto x : eqldims.expand( -1 ) ) xs.push_back( x );
+        CHECK( xs == std::vector< int >{ 5, 5, 5, -1, 2 } );
+
+        std::size_t n = 0;
+        double sum = 0;
+        for( const auto x : mapaxes.expand( 0.0 ) ) {
+            sum += x;
+            ++n;
+        }
+        CHECK( n == 1000006 );
+        CHECK( sum == 250000 + 1.5 + 2.5 + 6.0 );
+    }
+
+    SECTION( "filled in bulk" ) {
+        std::vector< double > xs( mapaxes.values(), -1 );
+        const lun::span< double > out{ xs.data(), xs.data() + xs.size() };
+
+        CHECK( mapaxes.fill( out, 7.0 ) == xs.size() );
+        CHECK( std::count( xs.begin(), xs.end(), 0.25 ) == 1000000 );
+        CHECK( std::vector< double >( xs.end() - 6, xs.end() )
+            == std::vector< double >{ 1.5, 2.5, 3.0, 3.0, 7.0, 7.0 } );
+    }
+
+    SECTION( "ints are read as doubles" ) {
+        std::vector< double > xs( 5 );
+        const lun::span< double > out{ xs.data(), xs.data() + xs.size() };
+        CHECK( eqldims.fill( out ) == 5 );
+        CHECK( xs == std::vector< double >{ 5, 5, 5, 0, 2 } );
+    }
+
+    SECTION( "doubles are not read as ints" ) {
+        std::vector< int > xs( mapaxes.values() );
+        const lun::span< int > out{ xs.data(), xs.data() + xs.size() };
+        CHECK_THROWS_AS( mapaxes.fill( out ), std::runtime_error );
+        CHECK_THROWS_AS( *mapaxes.expand< int >().begin(), std::runtime_error );
+    }
+
+    SECTION( "values must fit" ) {
+        std::vector< int > xs( 4 );
+        const lun::span< int > out{ xs.data(), xs.data() + xs.size() };
+        CHECK_THROWS_AS( eqldims.fill( out ), std::length_error );
+    }
+}
+
+TEST_CASE( "columns keep their values when they outgrow malloc", "[deck]" ) {
+    lun::column< double > xs;
+    const std::size_t n = 3 * lun::column< double >::mapthreshold / sizeof( double );
+
+    for( std::size_t i = 0; i < n; ++i ) xs.push_back( double( i ) );
+    const std::vector< double > tail( 100, 0.5 );
+    xs.append( tail.data(), tail.data() + tail.size() );
+    REQUIRE( xs.size() == n + 100 );
+
+    const auto check = [&]( const lun::column< double >& c ) {
+        bool same = true;
+        for( std::size_t i = 0; i < n; ++i ) same = same && c.data()[ i ] == i;
+        CHECK( same );
+        CHECK( c.data()[ n + 99 ] == 0.5 );
+    };
+
+    check( xs );
+    xs.shrink_to_fit();
+    check( xs );
+
+    auto moved = std::move( xs );
+    CHECK( xs.empty() );
+    check( moved );
+
+    moved.resize( 10 );
+    moved.shrink_to_fit();
+    CHECK( moved.size() == 10 );
+    CHECK( moved.data()[ 9 ] == 9 );
+
+    SECTION( "in a deck" ) {
+        std::string input = "ZCORN\n";
+        for( int i = 0; i < 200000; ++i ) input += " " + std::to_string( i ) + ".5";
+        input += " /\n";
+
+        const auto deck = lun::tabulate( input );
+        const auto zcorn = deck[ 0 ].doubles();
+        REQUIRE( zcorn.size() == 200000 );
+        CHECK( zcorn.begin()[ 0 ] == 0.5 );
+        CHECK( zcorn.begin()[ 199999 ] == 199999.5 );
+    }
+}
@@ -0,0 +1,105 @@
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <lunar/parser.hpp>
+
+#include <catch/catch.hpp>
+
+TEST_CASE( "dimensioning keywords are decoded into structs", "[decode]" ) {
+    const std::string input = "RUNSPEC\n"
+                              "DIMENS\n 10 20 30 /\n"
+                              "EQLDIMS\n 2 1* 30 /\n"
+                              "TABDIMS\n 2* 3*40 /\n"
+                              "WELLDIMS\n 5 6 7 8 9 10 11 12 13 /\n"
+                              "NSTACK\n /\n"
+                              "GRID\n";
+
+    const auto kws = lun::parse( input );
+    const auto deck = lun::tabulate( input );
+
+    const auto dims = lun::get< lun::dimens >( kws );
+    CHECK( dims.nx == 10 );
+    CHECK( dims.ny == 20 );
+    CHECK( dims.nz == 30 );
+
+    const auto eql = lun::get< lun::eqldims >( kws );
+    CHECK( eql.ntequl == 2 );
+    CHECK( eql.ndprvd == 100 );
+    CHECK( eql.ndrxvd == 30 );
+    CHECK( eql.nttrvd == 1 );
+    CHECK( eql.nstrvd == 20 );
+
+    const auto tab = deck.get< lun::tabdims >();
+    CHECK( tab.ntsfun == 1 );
+    CHECK( tab.ntpvt == 1 );
+    CHECK( tab.nssfun == 40 );
+    CHECK( tab.nppvt == 40 );
+    CHECK( tab.ntfip == 40 );
+    CHECK( tab.nrpvt == 20 );
+
+    /* items past the struct are ignored */
+    const auto wells = deck.get< lun::welldims >();
+    CHECK( wells.nwmaxz == 5 );
+    CHECK( wells.nwgmax == 8 );
+
+    CHECK( lun::get< lun::nstack >( kws ).lenstk == 10 );
+
+    SECTION( "parse() and tabulate() decode the same" ) {
+        const auto x = deck.get< lun::dimens >();
+        CHECK( x.nx == dims.nx );
+        CHECK( x.ny == dims.ny );
+        CHECK( x.nz == dims.nz );
+
+        const auto y = lun::get< lun::tabdims >( kws );
+        CHECK( y.nssfun == tab.nssfun );
+        CHECK( y.ntfip == tab.ntfip );
+        CHECK( y.nrpvt == tab.nrpvt );
+    }
+
+    SECTION( "missing keywords are out of range" ) {
+        CHECK_THROWS_AS( lun::get< lun::regdims >( kws ), std::out_of_range );
+        CHECK_THROWS_AS( deck.get< lun::regdims >(), std::out_of_range );
+    }
+
+    SECTION( "a keyword only decodes as its own struct" ) {
+        CHECK_THROWS_AS( lun::decode< lun::eqldims >( kws[ 1 ] ),
+                         std::runtime_error );
+        CHECK_THROWS_AS( lun::decode< lun::eqldims >( deck[ 1 ] ),
+                         std::runtime_error );
+    }
+}
+
+TEST_CASE( "required items must be given", "[decode]" ) {
+    const std::vector< std::string > inputs = {
+        "DIMENS\n 10 20 /\n",
+        "DIMENS\n 10 1* 30 /\n",
+        "DIMENS\n 3* /\n",
+        "DIMENS\n /\n",
+    };
+
+    for( const auto& input : inputs ) {
+        INFO( input );
+        const auto kws = lun::parse( input );
+        REQUIRE( kws.size() == 1 );
+        CHECK_THROWS_AS( lun::get< lun::dimens >( kws ), std::runtime_error );
+        CHECK_THROWS_AS( lun::tabulate( input ).get< lun::dimens >(),
+                         std::runtime_error );
+    }
+
+    const auto kws = lun::parse( "DIMENS\n 3*7 /\n" );
+    CHECK( lun::get< lun::dimens >( kws ).nz == 7 );
+}
+
+TEST_CASE( "items that aren't ints are rejected", "[decode]" ) {
+    const std::string input = "TABDIMS\n 1 'x' /\n";
+    const auto kws = lun::parse( input );
+    REQUIRE( kws.size() == 1 );
+    CHECK_THROWS_AS( lun::get< lun::tabdims >( kws ), std::runtime_error );
+    CHECK_THROWS_AS( lun::tabulate( input ).get< lun::tabdims >(),
+                     std::runtime_error );
+
+    /* but not past the fields of the struct */
+    const auto tail = lun::parse( "TABDIMS\n 1 2 3 4 5 6 'x' /\n" );
+    CHECK( lun::get< lun::tabdims >( tail ).nrpvt == 6 );
+}
@@ -1,7 +1,22 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <vector>
+
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#ifdef HAVE_ZSTD
+#include <boost/iostreams/filter/zstd.hpp>
+#endif
 
 #include <lunar/parser.hpp>
 #include <lunar/concatenate.hpp>
+#include <lunar/reader.hpp>
 
 #include <catch/catch.hpp>
 
@@ -70,6 +85,40 @@ SCENARIO( "path aliases are resolved", "[paths]" ) {
         WHEN( "the substitute isn't registered" ) {
             CHECK_THROWS( aliases.resolve( "$FOO" ) );
         }
+
+        WHEN( "an alias is redefined" ) {
+            CHECK( aliases.resolve( "$DIR/name" ) == "dir1/name" );
+
+            lun::pathresolver::kv redef[] = { { "DIR", "dir7" } };
+            aliases.insert( std::begin( redef ), std::end( redef ) );
+
+            THEN( "the later definition wins, also for resolved paths" ) {
+                CHECK( aliases.resolve( "$DIR" ) == "dir7" );
+                CHECK( aliases.resolve( "$DIR/name" ) == "dir7/name" );
+                CHECK( aliases.resolve( "$DOTDIR" ) == "./dir2" );
+            }
+        }
+
+        WHEN( "a resolver is copied" ) {
+            auto copy = aliases;
+            lun::pathresolver::kv extra[] = { { "NEW", "dir8" },
+                                              { "DIR", "dir9" } };
+            copy.insert( std::begin( extra ), std::end( extra ) );
+
+            THEN( "the copies are independent" ) {
+                CHECK( copy.resolve( "$NEW/$DIR" ) == "dir8/dir9" );
+                CHECK( copy.resolve( "$MULTI" ) == "dir3/dir4" );
+                CHECK( aliases.resolve( "$DIR" ) == "dir1" );
+                CHECK_THROWS( aliases.resolve( "$NEW" ) );
+            }
+        }
+
+        WHEN( "inputs have no aliases" ) {
+            THEN( "they are returned as-is" ) {
+                CHECK( aliases.resolve( "dir/name" ) == "dir/name" );
+                CHECK( aliases.resolve( "" ) == "" );
+            }
+        }
     }
 }
 
@@ -95,6 +144,17 @@ TEST_CASE( "valid include", "[include]" ) {
         auto cat = lun::concatenate( "decks/paths-with-backslash.data" );
         CHECK_THAT( str( cat.inlined ), Equals( "included-in-valid\n" ) );
     }
+
+    SECTION( "root given as an absolute path" ) {
+        char* abs = realpath( "decks/paths-in-recursive.data", nullptr );
+        REQUIRE( abs );
+        const std::string root = abs;
+        std::free( abs );
+
+        auto cat = lun::concatenate( root );
+        CHECK_THAT( str( cat.inlined ), Equals( "included-in-valid\n" ) );
+        CHECK( cat.included.back().front() == '/' );
+    }
 }
 
 TEST_CASE( "include with wrong case", "[include]" ) {
@@ -106,3 +166,434 @@ TEST_CASE( "include with wrong case", "[include]" ) {
 TEST_CASE( "include non-existent file", "[include]" ) {
     CHECK_THROWS( lun::concatenate( "void.data" ) );
 }
+
+TEST_CASE( "splice does not copy the input", "[include][rope]" ) {
+    using Catch::Matchers::Equals;
+
+    const auto sp = lun::splice( "decks/paths-in-recursive.data" );
+    const auto cat = lun::concatenate( "decks/paths-in-recursive.data" );
+
+    SECTION( "spliced and concatenated output is the same" ) {
+        CHECK_THAT( str( sp.inlined ), Equals( str( cat.inlined ) ) );
+        CHECK( sp.inlined.size() == cat.inlined.size() );
+        CHECK( sp.included == cat.included );
+    }
+
+    SECTION( "chunks cover the output with no empty chunks" ) {
+        std::string out;
+        for( const auto& chunk : sp.inlined.chunks() ) {
+            CHECK( !chunk.empty() );
+            out.append( chunk.begin(), chunk.end() );
+        }
+
+        CHECK_THAT( out, Equals( "included-in-valid\n" ) );
+    }
+
+    SECTION( "the rope outlives copies of it" ) {
+        lun::rope copy;
+        {
+            auto tmp = lun::splice( "decks/valid.data" );
+            copy = tmp.inlined;
+        }
+
+        CHECK_THAT( str( copy ), Equals( "included-in-valid\n" ) );
+    }
+
+    SECTION( "flatten gives the concatenated deck" ) {
+        const auto flat = lun::flatten( sp );
+        CHECK( flat.inlined == cat.inlined );
+        CHECK( flat.included == cat.included );
+    }
+}
+
+TEST_CASE( "concatenate can stream to a sink", "[include][stream]" ) {
+    using Catch::Matchers::Equals;
+
+    const std::string deck = "decks/text-around-include.data";
+    const auto cat = lun::concatenate( deck );
+    const auto expected = str( cat.inlined );
+    REQUIRE_THAT( expected, Equals( "RUNSPEC\nincluded-in-valid\nGRID\n" ) );
+
+    SECTION( "to a callback, in bounded chunks" ) {
+        for( std::size_t chunksize : { 1, 3, 8, 1 << 20 } ) {
+            std::string out;
+            auto sink = [&]( const char* fst, const char* lst ) {
+                CHECK( std::size_t( lst - fst ) <= chunksize );
+                out.append( fst, lst );
+            };
+
+            const auto included = lun::concatenate( deck, sink, chunksize );
+            CHECK_THAT( out, Equals( expected ) );
+            CHECK( included == cat.included );
+        }
+    }
+
+    SECTION( "to an ostream" ) {
+        std::ostringstream stream;
+        const auto included = lun::concatenate( deck, stream );
+        CHECK_THAT( stream.str(), Equals( expected ) );
+        CHECK( included == cat.included );
+    }
+
+    SECTION( "to a file descriptor" ) {
+        auto* fp = std::tmpfile();
+        REQUIRE( fp );
+
+        const auto included = lun::concatenate( deck, fileno( fp ), 5 );
+        CHECK( included == cat.included );
+
+        std::rewind( fp );
+        std::string out;
+        for( int c; ( c = std::fgetc( fp ) ) != EOF; )
+            out.push_back( char( c ) );
+        std::fclose( fp );
+
+        CHECK_THAT( out, Equals( expected ) );
+    }
+
+    SECTION( "a zero chunksize is rejected" ) {
+        auto sink = []( const char*, const char* ) {};
+        CHECK_THROWS( lun::concatenate( deck, sink, 0 ) );
+    }
+}
+
+TEST_CASE( "prefetched includes give the same output", "[include][prefetch]" ) {
+    using Catch::Matchers::Equals;
+
+    lun::concatopts opts;
+    opts.prefetch = 2;
+
+    std::vector< std::string > opened;
+    std::mutex mx;
+    opts.before_open = [&]( const std::string& path ) {
+        std::lock_guard< std::mutex > lock( mx );
+        opened.push_back( path );
+    };
+
+    for( const auto& deck : { "decks/valid.data",
+                              "decks/paths-in-root.data",
+                              "decks/paths-in-recursive.data",
+                              "decks/paths-with-backslash.data",
+                              "decks/text-around-include.data" } ) {
+        INFO( "deck: " << deck );
+        opened.clear();
+
+        const auto expected = lun::concatenate( deck );
+        const auto cat = lun::concatenate( deck, opts );
+        CHECK( cat.inlined == expected.inlined );
+        CHECK( cat.included == expected.included );
+
+        /* every included file must have gone through the hook */
+        for( const auto& inc : cat.included ) {
+            CHECK( std::find( opened.begin(), opened.end(), inc )
+                   != opened.end() );
+        }
+    }
+
+    SECTION( "failed includes are still reported" ) {
+        CHECK_THROWS( lun::concatenate( "decks/wrong-case-filename.data",
+                                        opts ) );
+        CHECK_THROWS( lun::concatenate( "decks/wrong-case-dirname.data",
+                                        opts ) );
+    }
+}
+
+TEST_CASE( "repeated includes are mapped once", "[include]" ) {
+    using Catch::Matchers::Equals;
+
+    int opens = 0;
+    lun::concatopts opts;
+    opts.before_open = [&opens]( const std::string& ) { ++opens; };
+
+    const auto cat = lun::concatenate( "decks/repeated-include.data", opts );
+    CHECK_THAT( str( cat.inlined ),
+                Equals( "included-in-valid\n"
+                        "included-in-valid\n"
+                        "included-in-valid\n" ) );
+    CHECK( cat.included.size() == 4 );
+
+    /*
+     * the same name is never opened twice, but the last include is by a
+     * different name, so it must be opened to find that it's the same file
+     */
+    CHECK( opens == 3 );
+}
+
+TEST_CASE( "include cycles are detected", "[include]" ) {
+    using Catch::Matchers::Contains;
+
+    SECTION( "a file including itself" ) {
+        CHECK_THROWS_WITH( lun::concatenate( "decks/cycle-self.data" ),
+                           Contains( "cycle" ) );
+    }
+
+    SECTION( "the chain is reported" ) {
+        CHECK_THROWS_WITH( lun::concatenate( "decks/cycle-a.data" ),
+                           Contains( "decks/cycle-a.data -> " ) &&
+                           Contains( "include-cycle/b.inc -> " ) );
+    }
+
+    SECTION( "when streaming and prefetching too" ) {
+        lun::concatopts opts;
+        opts.prefetch = 2;
+        auto sink = []( const char*, const char* ) {};
+        CHECK_THROWS( lun::concatenate( "decks/cycle-a.data", sink, 8, opts ) );
+    }
+}
+
+TEST_CASE( "output offsets are mapped back to file and line",
+           "[include][sourcemap]" ) {
+    lun::concatopts opts;
+    opts.sourcemap = true;
+
+    SECTION( "text around an include" ) {
+        const auto cat = lun::concatenate( "decks/text-around-include.data",
+                                           opts );
+        const auto* out = cat.inlined.data();
+        REQUIRE( cat.map.size == cat.inlined.size() );
+
+        /* RUNSPEC */
+        const auto runspec = cat.map.locate( 0, out );
+        CHECK( runspec.file == 0 );
+        CHECK( runspec.offset == 0 );
+        CHECK( runspec.line == 1 );
+
+        /* included-in-valid */
+        const auto inc = cat.map.locate( 8, out );
+        CHECK( inc.file == 1 );
+        CHECK( inc.offset == 0 );
+        CHECK( inc.line == 1 );
+
+        /* GRID, after the three lines of RUNSPEC and INCLUDE */
+        const auto grid = cat.map.locate( 26, out );
+        CHECK( grid.file == 0 );
+        CHECK( grid.line == 4 );
+        CHECK( grid.offset == 59 );
+
+        CHECK_THROWS_AS( cat.map.locate( cat.inlined.size(), out ),
+                         std::out_of_range );
+    }
+
+    SECTION( "no map unless asked for" ) {
+        const auto cat = lun::concatenate( "decks/text-around-include.data" );
+        CHECK( cat.map.intervals.empty() );
+    }
+
+    SECTION( "every line of a large file" ) {
+        /*
+         * every line of the root says what line it's on, and is long enough
+         * in total to span several intervals
+         */
+        std::string root;
+        for( int i = 1; i <= 10000; ++i )
+            root += "x" + std::to_string( i ) + "\n";
+        root += "PATHS\n 'D' 'decks/include-valid' /\n/\n";
+        root += "INCLUDE\n '$D/include-in-valid.inc' /\n";
+        for( int i = 10006; i <= 20005; ++i )
+            root += "x" + std::to_string( i ) + "\n";
+
+        const std::string path = "sourcemap.data";
+        {
+            std::ofstream fs( path, std::ios::trunc );
+            fs << root;
+        }
+
+        const auto cat = lun::concatenate( path, opts );
+        std::remove( path.c_str() );
+        CHECK( cat.map.intervals.size() > 1 );
+
+        const std::string out( cat.inlined.begin(), cat.inlined.end() );
+        std::size_t lines = 0;
+        for( std::size_t pos = 0; pos < out.size(); ) {
+            const auto eol = out.find( '\n', pos );
+            const auto line = out.substr( pos, eol - pos );
+            const auto loc = cat.map.locate( pos, out.data() );
+            ++lines;
+
+            INFO( "line: " << line );
+            if( line == "included-in-valid" ) {
+                CHECK( loc.file == 1 );
+                CHECK( loc.line == 1 );
+            } else {
+                CHECK( loc.file == 0 );
+                CHECK( "x" + std::to_string( loc.line ) == line );
+                CHECK( root.compare( loc.offset, line.size(), line ) == 0 );
+            }
+
+            /* the middle of a line is on the same line */
+            const auto half = pos + line.size() / 2;
+            const auto mid = cat.map.locate( half, out.data() );
+            CHECK( mid.line == loc.line );
+
+            pos = eol + 1;
+        }
+
+        CHECK( lines == 20001 );
+    }
+}
+
+TEST_CASE( "every reader gives the same output", "[include][reader]" ) {
+    using Catch::Matchers::Equals;
+
+    /*
+     * large enough to be mapped by the automatic reader, and to be read in
+     * several pieces by io_uring
+     */
+    const std::string large = "large-include.inc";
+    {
+        std::ofstream fs( large, std::ios::trunc );
+        for( int i = 0; i < 100000; ++i )
+            fs << "    0.25 0.5 0.75 1.0 1.25 1.5 1.75 2.0 /\n";
+    }
+
+    const std::string root = "large-root.data";
+    {
+        std::ofstream fs( root, std::ios::trunc );
+        fs << "RUNSPEC\nINCLUDE\n '" << large << "' /\nGRID\n"
+           << "INCLUDE\n '" << large << "' /\n";
+    }
+
+    for( auto r : { lun::reader::automatic,
+                    lun::reader::mmap,
+                    lun::reader::pread,
+                    lun::reader::uring } ) {
+        lun::concatopts opts;
+        opts.reader = r;
+
+        for( const auto& deck : { std::string( "decks/valid.data" ),
+                                  std::string( "decks/paths-in-root.data" ),
+                                  std::string( "decks/repeated-include.data" ),
+                                  std::string( "decks/text-around-include.data" ),
+                                  root } ) {
+            INFO( "reader: " << lun::reader_name( r ) << ", deck: " << deck );
+
+            const auto expected = lun::concatenate( deck );
+            const auto cat = lun::concatenate( deck, opts );
+            CHECK( cat.inlined == expected.inlined );
+            CHECK( cat.included == expected.included );
+
+            /*
+             * streaming releases the memory of what's been written, but a
+             * repeated include must still read back the same
+             */
+            std::ostringstream stream;
+            lun::concatenate( deck, stream, 4096, opts );
+            CHECK( stream.str() == str( expected.inlined ) );
+        }
+
+        CHECK_THROWS( lun::concatenate( "decks/wrong-case-filename.data",
+                                        opts ) );
+    }
+
+    std::remove( root.c_str() );
+    std::remove( large.c_str() );
+}
+
+namespace {
+
+template< typename Compressor >
+void compress( const std::string& path,
+               const std::string& contents,
+               Compressor filter ) {
+    namespace io = boost::iostreams;
+    std::ofstream fs( path, std::ios::binary | std::ios::trunc );
+    io::filtering_ostream out;
+    out.push( filter );
+    out.push( fs );
+    out << contents;
+}
+
+}
+
+TEST_CASE( "compressed files are decompressed", "[include][compressed]" ) {
+    using Catch::Matchers::Equals;
+    using Catch::Matchers::Contains;
+
+    const std::string inc = "    0.25 0.5 0.75 1.0 /\n"
+                            "    1.25 1.5 1.75 2.0 /\n";
+
+    const auto root = []( const std::string& include ) {
+        return "RUNSPEC\nINCLUDE\n '" + include + "' /\nGRID\n";
+    };
+
+    const auto expected = "RUNSPEC\n" + inc + "GRID\n";
+
+    SECTION( "a gzip include" ) {
+        compress( "compressed.inc.gz", inc,
+                  boost::iostreams::gzip_compressor() );
+        compress( "gzip-root.data.gz", root( "compressed.inc.gz" ),
+                  boost::iostreams::gzip_compressor() );
+
+        const auto cat = lun::concatenate( "gzip-root.data.gz" );
+        CHECK_THAT( str( cat.inlined ), Equals( expected ) );
+
+        for( auto r : { lun::reader::mmap, lun::reader::uring } ) {
+            lun::concatopts opts;
+            opts.reader = r;
+            std::ostringstream stream;
+            lun::concatenate( "gzip-root.data.gz", stream, 8, opts );
+            CHECK_THAT( stream.str(), Equals( expected ) );
+        }
+
+        std::remove( "compressed.inc.gz" );
+        std::remove( "gzip-root.data.gz" );
+    }
+
+    SECTION( "a gzip include of several members" ) {
+        /*
+         * the recorded size is only that of the last, small, member, so the
+         * buffer has to grow past it
+         */
+        std::string large;
+        for( int i = 0; i < 10000; ++i ) large += inc;
+
+        compress( "first.gz", large, boost::iostreams::gzip_compressor() );
+        compress( "last.gz", inc, boost::iostreams::gzip_compressor() );
+        {
+            std::ifstream first( "first.gz", std::ios::binary );
+            std::ifstream last( "last.gz", std::ios::binary );
+            std::ofstream fs( "members.inc.gz",
+                              std::ios::binary | std::ios::trunc );
+            fs << first.rdbuf() << last.rdbuf();
+            std::ofstream root_fs( "members-root.data", std::ios::trunc );
+            root_fs << root( "members.inc.gz" );
+        }
+
+        const auto cat = lun::concatenate( "members-root.data" );
+        CHECK( str( cat.inlined ) == "RUNSPEC\n" + large + inc + "GRID\n" );
+
+        std::remove( "first.gz" );
+        std::remove( "last.gz" );
+        std::remove( "members.inc.gz" );
+        std::remove( "members-root.data" );
+    }
+
+#ifdef HAVE_ZSTD
+    SECTION( "a zstd include" ) {
+        /* compression is detected by contents, not by name */
+        compress( "compressed.inc", inc,
+                  boost::iostreams::zstd_compressor() );
+        {
+            std::ofstream fs( "zstd-root.data", std::ios::trunc );
+            fs << root( "compressed.inc" );
+        }
+
+        const auto cat = lun::concatenate( "zstd-root.data" );
+        CHECK_THAT( str( cat.inlined ), Equals( expected ) );
+
+        std::remove( "compressed.inc" );
+        std::remove( "zstd-root.data" );
+    }
+#endif
+
+    SECTION( "a corrupt file is an error" ) {
+        {
+            std::ofstream fs( "corrupt.data.gz", std::ios::trunc );
+            fs << "\x1f\x8b not really gzip";
+        }
+
+        CHECK_THROWS_WITH( lun::concatenate( "corrupt.data.gz" ),
+                           Contains( "corrupt.data.gz" ) );
+        std::remove( "corrupt.data.gz" );
+    }
+}
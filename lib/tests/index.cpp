@@ -0,0 +1,96 @@
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <lunar/parser.hpp>
+
+#include <catch/catch.hpp>
+
+namespace {
+
+std::string show( const lun::keyword& kw ) {
+    std::ostringstream stream;
+    stream << kw.name << ":";
+    for( const auto& x : kw.xs ) stream << x << x.repeat;
+    return stream.str();
+}
+
+}
+
+TEST_CASE( "an index has the same keywords as parse()", "[index]" ) {
+    const std::vector< std::string > inputs = {
+        "",
+        "RUNSPEC\nOIL\nWATER\n",
+        "DIMENS\n 10 20 30 /\n",
+        "DIMENS\n 10 2* /\nEQLDIMS\n * 1 3* 5 /\n",
+        "GRIDOPTS\n 'YES' 2* /\nEQLOPTS\n 'A' \"B\" C1 /\n",
+        "TRACERS\n 1 2.5 'x' 3*4 2*1.5D2 -- comment\n 4* /\n",
+        "EQLOPTS\n 'a/b' \"--\" -- '/\n /\nGRID\n",
+        "MAPAXES\n 0.0 1.5 1D2 -2.5e-3 3*0.25 / trailing\nGRID\nNEWTRAN\n",
+        "DIMENS\n 1 2 3 /\nSCHEDULE\nDIMENS\n 4 5 6 /\n",
+    };
+
+    for( const auto& input : inputs ) {
+        INFO( input );
+        const auto kws = lun::parse( input );
+        const auto index = lun::scan( input );
+
+        REQUIRE( index.size() == kws.size() );
+        for( std::size_t i = 0; i < kws.size(); ++i ) {
+            CHECK( index.name( i ) == kws[ i ].name );
+            CHECK( show( index[ i ] ) == show( kws[ i ] ) );
+        }
+    }
+}
+
+TEST_CASE( "keywords are parsed once, and on demand", "[index]" ) {
+    const std::string input = "DIMENS\n 10 20 30 /\n"
+                              "MAPAXES\n 1.0 'x' /\n"
+                              "GRID\n";
+    const auto index = lun::scan( input );
+
+    const auto* dimens = index.find( "DIMENS" );
+    REQUIRE( dimens );
+    CHECK( dimens == &index[ 0 ] );
+    CHECK( show( *dimens ) == show( lun::parse( "DIMENS\n 10 20 30 /\n" )[ 0 ] ) );
+
+    /* MAPAXES is broken, but only reading it fails */
+    CHECK( index.name( 1 ) == "MAPAXES" );
+    CHECK_THROWS_AS( index[ 1 ], std::runtime_error );
+    CHECK_THROWS_AS( index[ 1 ], std::runtime_error );
+    CHECK( index.find( "GRID" ) == &index[ 2 ] );
+
+    CHECK( index.size() == 3 );
+    CHECK_THROWS_AS( index[ 3 ], std::out_of_range );
+    CHECK_THROWS_AS( index.name( 3 ), std::out_of_range );
+
+    /* copies share what's been read */
+    const auto copy = index;
+    CHECK( copy.find( "DIMENS" ) == dimens );
+}
+
+TEST_CASE( "the index only reads as far as it has to", "[index]" ) {
+    /* the rest of the deck is never skimmed, so the unterminated string is fine */
+    const std::string input = "RUNSPEC\nDIMENS\n 1 2 3 /\nEQLOPTS\n 'never";
+    const auto index = lun::scan( input );
+
+    const auto* dimens = index.find( "DIMENS" );
+    REQUIRE( dimens );
+    CHECK( dimens->xs.size() == 4 );
+
+    /* but like parse(), the index stops where the deck is broken */
+    CHECK( !index.find( "EQLOPTS" ) );
+    CHECK( index.size() == 2 );
+}
+
+TEST_CASE( "an empty index has no keywords", "[index]" ) {
+    const lun::index index;
+    CHECK( index.empty() );
+    CHECK( index.size() == 0 );
+    CHECK( !index.find( "DIMENS" ) );
+    CHECK_THROWS_AS( index[ 0 ], std::out_of_range );
+
+    const std::string input;
+    CHECK( lun::scan( input ).empty() );
+}
@@ -0,0 +1,243 @@
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <lunar/parser.hpp>
+
+#include <catch/catch.hpp>
+
+namespace {
+
+std::string show( const std::vector< lun::keyword >& kws ) {
+    std::ostringstream stream;
+    for( const auto& kw : kws ) {
+        stream << kw.name << ":";
+        for( const auto& x : kw.xs ) stream << x;
+        stream << "\n";
+    }
+    return stream.str();
+}
+
+std::string deck( int i ) {
+    return "RUNSPEC\n"
+           "DIMENS\n"
+           "    " + std::to_string( i ) + " 10 3 /\n"
+           "-- a comment " + std::to_string( i ) + "\n"
+           "GRIDOPTS\n"
+           "    'YES' " + std::to_string( i % 7 ) + "* /\n"
+           "TRACERS\n"
+           "    1 2.5 'x' 3*4 /\n"
+           "GRID\n"
+           "MAPAXES\n"
+           "    0.0 " + std::to_string( i ) + ".5 1D2 /\n"
+           ;
+}
+
+}
+
+TEST_CASE( "a parser can be reused", "[parser]" ) {
+    const lun::parser p;
+
+    for( int i = 0; i < 10; ++i ) {
+        const auto input = deck( i );
+        const auto sec = p.parse( input );
+        CHECK( sec.size() == 6 );
+        CHECK( show( sec ) == show( lun::parse( input ) ) );
+    }
+}
+
+TEST_CASE( "parsers can be moved", "[parser]" ) {
+    lun::parser p;
+    lun::parser q( std::move( p ) );
+
+    const auto input = deck( 1 );
+    CHECK( show( q.parse( input ) ) == show( lun::parse( input ) ) );
+}
+
+TEST_CASE( "a parser can be shared between threads", "[parser][threads]" ) {
+    /*
+     * this is mostly useful when built with -DLUNAR_TSAN=ON, which will
+     * report any data race in the parser
+     */
+    const int decks = 64;
+    const int threads = 8;
+
+    std::vector< std::string > inputs;
+    std::vector< std::string > expected;
+    for( int i = 0; i < decks; ++i ) {
+        inputs.push_back( deck( i ) );
+        expected.push_back( show( lun::parse( inputs.back() ) ) );
+    }
+
+    SECTION( "one parser, many threads" ) {
+        const lun::parser p;
+        std::vector< std::vector< std::string > > results( threads );
+
+        std::vector< std::thread > workers;
+        for( int t = 0; t < threads; ++t ) {
+            workers.emplace_back( [&, t] {
+                for( int i = 0; i < decks; ++i ) {
+                    const auto& input = inputs[ ( i + t ) % decks ];
+                    results[ t ].push_back( show( p.parse( input ) ) );
+                }
+            });
+        }
+
+        for( auto& w : workers ) w.join();
+
+        for( int t = 0; t < threads; ++t ) {
+            for( int i = 0; i < decks; ++i )
+                CHECK( results[ t ][ i ] == expected[ ( i + t ) % decks ] );
+        }
+    }
+
+    SECTION( "many parsers, made concurrently" ) {
+        std::vector< std::string > results( threads );
+
+        std::vector< std::thread > workers;
+        for( int t = 0; t < threads; ++t ) {
+            workers.emplace_back( [&, t] {
+                const lun::parser p;
+                results[ t ] = show( p.parse( inputs[ t ] ) );
+            });
+        }
+
+        for( auto& w : workers ) w.join();
+
+        for( int t = 0; t < threads; ++t )
+            CHECK( results[ t ] == expected[ t ] );
+    }
+}
+
+namespace {
+
+/*
+ * A deck large enough to be split in three, where many lines that start
+ * with a keyword are not keyword boundaries. There are bare words in
+ * records, and from 60% to 75% of the deck is a single string that looks
+ * like keywords, so the chunks before it are good, and the ones after are
+ * not.
+ */
+std::string large( int n ) {
+    std::string s;
+    const auto decks = [&]( int m ) {
+        for( int i = 0; i < m; ++i ) {
+            s += deck( i );
+            s += "EQLOPTS\n A\nGRID /\n";
+        }
+    };
+
+    decks( n );
+    const auto size = s.size();
+    s += "EQLOPTS\n 'first\n";
+    while( s.size() < size + size / 4 ) s += "DIMENS\n 1 2 3 /\n";
+    s += "' /\n";
+    decks( n * 5 / 12 );
+
+    return s;
+}
+
+}
+
+TEST_CASE( "a deck parsed in parallel is the same as in sequence",
+           "[parser][threads]" ) {
+    const auto input = large( 13200 );
+    const auto expected = show( lun::parse( input ) );
+
+    lun::parseopts opts;
+    opts.threads = 4;
+
+    SECTION( "the whole deck is parsed" ) {
+        const auto sec = lun::parse( input, opts );
+        CHECK( sec.size() == ( 13200 + 5500 ) * 7 + 1 );
+        CHECK( show( sec ) == expected );
+    }
+
+    SECTION( "a broken deck stops at the same place" ) {
+        auto broken = input;
+        const auto at = broken.find( "GRID\nMAPAXES", broken.size() / 6 );
+        broken.insert( at, "DIMENS\n 1 2.5 /\n" );
+        const auto sequential = show( lun::parse( broken ) );
+        CHECK( sequential.size() < expected.size() );
+        CHECK( show( lun::parse( broken, opts ) ) == sequential );
+    }
+}
+
+TEST_CASE( "only the wanted sections are parsed", "[parser][sections]" ) {
+    const std::string input = "NOSIM\n"
+                              "RUNSPEC\n"
+                              "DIMENS\n 10 20 30 /\n"
+                              "OIL\n"
+                              "GRID\n"
+                              "MAPAXES\n 0.0 1.5 1D2 /\n"
+                              "PROPS\n"
+                              "SWOF\n 0.1 0.0 1.0 0.0\n 1.0 1.0 0.0 0.0 /\n"
+                              "  SCHEDULE -- indented\n"
+                              "WELSPECS\n 'P1' 'G1' 1 1 1* 'OIL' /\n/\n"
+                              "-- GRID in a comment\n"
+                              "TSTEP\n 10*30 /\n";
+
+    const auto parse = [&]( std::vector< std::string > sections ) {
+        lun::parseopts opts;
+        opts.sections = sections;
+        return show( lun::parse( input, opts ) );
+    };
+
+    const auto full = lun::parse( input );
+    const auto runspec = show( { full.begin(), full.begin() + 4 } );
+    const auto grid = show( { full.begin() + 4, full.begin() + 6 } );
+    const auto prelude = show( { full.begin(), full.begin() + 1 } );
+
+    CHECK( parse( { "RUNSPEC" } ) == runspec );
+    CHECK( parse( { "GRID" } ) == prelude + grid );
+    CHECK( parse( { "RUNSPEC", "GRID" } ) == runspec + grid );
+
+    /* wanted sections still stop at keywords the parser doesn't know */
+    CHECK( parse( { "PROPS" } ) == prelude + "PROPS:\n" );
+    CHECK( parse( { "SCHEDULE" } ) == prelude + "SCHEDULE:\n" );
+    CHECK( parse( { "GRID", "SCHEDULE" } )
+        == prelude + grid + "SCHEDULE:\n" );
+
+    CHECK_THROWS_AS( parse( { "RUNSPEC", "WELLS" } ), std::invalid_argument );
+}
+
+TEST_CASE( "keywords have dense IDs", "[parser][keywordid]" ) {
+    const auto n = std::size_t( lun::keywordid::unknown );
+
+    for( std::size_t i = 0; i < n; ++i ) {
+        const auto id = lun::keywordid( i );
+        const std::string name = lun::name( id );
+        INFO( name );
+        CHECK( lun::lookup( name ) == id );
+        CHECK( lun::lookup( name + "S" ) == lun::keywordid::unknown );
+        CHECK( lun::lookup( name.substr( 1 ) ) == lun::keywordid::unknown );
+    }
+
+#define CHECK_KEYWORD_NAME( kw ) \
+    CHECK( std::string( lun::name( lun::keywordid::kw ) ) == #kw );
+    LUNAR_KEYWORD_LIST( CHECK_KEYWORD_NAME )
+#undef CHECK_KEYWORD_NAME
+
+    CHECK_THROWS_AS( lun::name( lun::keywordid::unknown ), std::out_of_range );
+
+    CHECK( lun::lookup( "" ) == lun::keywordid::unknown );
+    CHECK( lun::lookup( "dimens" ) == lun::keywordid::unknown );
+    CHECK( lun::lookup( "WELSPECS" ) == lun::keywordid::unknown );
+
+    const std::string input = "DIMENS\n 1 2 3 /\nGRID\nPORO\n 0.25 /\n";
+    const auto kws = lun::parse( input );
+    REQUIRE( kws.size() == 3 );
+    CHECK( kws[ 0 ].id == lun::keywordid::DIMENS );
+    CHECK( kws[ 1 ].id == lun::keywordid::GRID );
+    CHECK( kws[ 2 ].id == lun::keywordid::PORO );
+
+    const auto deck = lun::tabulate( input );
+    REQUIRE( deck.size() == 3 );
+    CHECK( deck[ 0 ].id() == lun::keywordid::DIMENS );
+    CHECK( deck.keywords()[ 2 ].id == lun::keywordid::PORO );
+
+    const auto index = lun::scan( input );
+    CHECK( index[ 1 ].id == lun::keywordid::GRID );
+}
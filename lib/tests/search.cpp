@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <lunar/search.hpp>
+
+#include <catch/catch.hpp>
+
+namespace {
+
+/*
+ * The obviously correct, and slow, reference search: check every position for
+ * either keyword, and if found, verify that only blanks precede it on the
+ * line.
+ */
+const char* reference( const char* begin, const char* end ) {
+    const std::string incl = "INCLUDE";
+    const std::string paths = "PATHS";
+
+    for( auto fst = begin; fst != end; ++fst ) {
+        const std::string rest( fst, end );
+        if( rest.compare( 0, incl.size(), incl ) != 0
+         && rest.compare( 0, paths.size(), paths ) != 0 )
+            continue;
+
+        auto prev = fst;
+        while( prev != begin && ( prev[-1] == ' ' || prev[-1] == '\t' ) )
+            --prev;
+
+        if( prev == begin || prev[-1] == '\n' ) return fst;
+    }
+
+    return end;
+}
+
+std::vector< lun::kernel > kernels() {
+    std::vector< lun::kernel > ks;
+    for( auto k : { lun::kernel::scalar,
+                    lun::kernel::sse2,
+                    lun::kernel::avx2,
+                    lun::kernel::avx512 } ) {
+        if( lun::search_kernel( k ) ) ks.push_back( k );
+    }
+
+    return ks;
+}
+
+void check_all( const std::string& input ) {
+    const auto* begin = input.data();
+    const auto* end = begin + input.size();
+    const auto expected = reference( begin, end ) - begin;
+
+    for( auto k : kernels() ) {
+        INFO( "kernel: " << lun::kernel_name( k ) );
+        INFO( "input: '" << input << "'" );
+        const auto fn = lun::search_kernel( k );
+        CHECK( fn( begin, end ) - begin == expected );
+    }
+
+    CHECK( lun::search( begin, end ) - begin == expected );
+}
+
+}
+
+TEST_CASE( "the scalar kernel is always available", "[search]" ) {
+    CHECK( lun::search_kernel( lun::kernel::scalar ) );
+}
+
+TEST_CASE( "keywords are found at line starts only", "[search]" ) {
+    check_all( "" );
+    check_all( "INCLUDE" );
+    check_all( "PATHS" );
+    check_all( "INCLUD" );
+    check_all( "PATH" );
+    check_all( "1 2 3\nINCLUDE\n 'file' /\n" );
+    check_all( "1 2 3\n   \tPATHS\n 'A' 'b' /\n/\n" );
+    check_all( "-- INCLUDE in a comment\n1 2 3\n" );
+    check_all( "1 2 INCLUDE\n" );
+    check_all( "   INCLUDE at the start with leading blanks" );
+    check_all( "PORO PERMX\nPVTO\nINCLUDX\nINCLUDE\n" );
+}
+
+TEST_CASE( "keywords are found at every offset", "[search]" ) {
+    /*
+     * shift the keyword across a couple of 64-byte blocks, to check that
+     * block boundaries, tails and the first-character check all agree
+     */
+    for( const std::string kw : { "INCLUDE", "PATHS" } ) {
+        for( std::size_t pad = 0; pad < 140; ++pad ) {
+            const std::string noise( pad, '1' );
+
+            check_all( noise + "\n" + kw + "\n" );
+            check_all( noise + "\n" + kw );
+            check_all( noise + " " + kw + "\n" );
+            check_all( std::string( pad, ' ' ) + kw );
+            check_all( noise + "\n" + kw.substr( 0, kw.size() - 1 ) );
+        }
+    }
+}
+
+TEST_CASE( "adversarial inputs agree with the reference", "[search]" ) {
+    SECTION( "only candidate characters" ) {
+        check_all( std::string( 300, 'I' ) );
+        check_all( std::string( 300, 'P' ) );
+        check_all( std::string( 300, '\n' ) );
+    }
+
+    SECTION( "almost-keywords on every line" ) {
+        std::string input;
+        for( int i = 0; i < 50; ++i )
+            input += "INCLUD\nPATH\n IINCLUDE\n\tPPATHS\n";
+
+        check_all( input );
+        check_all( input + "PATHS" );
+    }
+
+    SECTION( "keywords preceded by anything but blanks" ) {
+        std::string input;
+        for( int i = 0; i < 50; ++i )
+            input += "xINCLUDE\n-PATHS\n\rINCLUDE\n";
+
+        check_all( input );
+        check_all( input + "\n \t \tINCLUDE" );
+    }
+}
+
+TEST_CASE( "random inputs agree with the reference", "[search]" ) {
+    /*
+     * draw from an alphabet that is heavy on keyword characters and line
+     * breaks, so that near-matches are plentiful
+     */
+    const std::string alphabet = "INCLUDEPATHS \t\n\n\n 0123456789.*/-'";
+
+    std::mt19937 gen( 8128 );
+    std::uniform_int_distribution< std::size_t > len( 0, 400 );
+    std::uniform_int_distribution< std::size_t > pick( 0, alphabet.size() - 1 );
+    std::uniform_int_distribution< int > coin( 0, 3 );
+
+    for( int i = 0; i < 2000; ++i ) {
+        std::string input;
+        const auto n = len( gen );
+
+        while( input.size() < n ) {
+            switch( coin( gen ) ) {
+                case 0: input += "\nINCLUDE"; break;
+                case 1: input += "\nPATHS"; break;
+                default: input += alphabet[ pick( gen ) ];
+            }
+        }
+
+        check_all( input );
+    }
+}
+
+TEST_CASE( "newlines are counted", "[search][newlines]" ) {
+    std::mt19937 gen( 496 );
+    std::uniform_int_distribution< int > coin( 0, 4 );
+
+    for( std::size_t len = 0; len < 300; ++len ) {
+        std::string input;
+        for( std::size_t i = 0; i < len; ++i )
+            input.push_back( coin( gen ) == 0 ? '\n' : 'x' );
+
+        const auto* fst = input.data();
+        const auto* lst = fst + input.size();
+        const auto expected = std::count( fst, lst, '\n' );
+
+        for( auto k : kernels() ) {
+            INFO( "kernel: " << lun::kernel_name( k ) << ", len: " << len );
+            CHECK( lun::newline_kernel( k )( fst, lst ) == expected );
+        }
+
+        CHECK( lun::newlines( fst, lst ) == std::size_t( expected ) );
+    }
+}
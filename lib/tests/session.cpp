@@ -0,0 +1,172 @@
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <lunar/parser.hpp>
+#include <lunar/incremental.hpp>
+
+#include <catch/catch.hpp>
+
+namespace {
+
+std::string tempdir() {
+    char tmpl[] = "/tmp/lunar-session-XXXXXX";
+    return mkdtemp( tmpl );
+}
+
+void write( const std::string& path, const std::string& contents ) {
+    std::ofstream fs( path, std::ios::trunc );
+    fs << contents;
+}
+
+std::string show( const std::vector< lun::keyword >& kws ) {
+    std::ostringstream stream;
+    for( const auto& kw : kws ) {
+        stream << kw.name << ":";
+        for( const auto& x : kw.xs ) stream << x << x.repeat;
+        stream << "\n";
+    }
+    return stream.str();
+}
+
+std::string show( const lun::session& s ) {
+    return show( s.keywords() );
+}
+
+std::string reparse( const lun::session& s ) {
+    return show( lun::parse( s.inlined().inlined ) );
+}
+
+}
+
+TEST_CASE( "retracking gives the same keywords as parsing again", "[session]" ) {
+    const std::string base = "RUNSPEC\nDIMENS\n 10 20 30 /\nOIL\nWATER\n"
+                             "EQLDIMS\n * 1 3* 5 /\n"
+                             "GRID\nMAPAXES\n 0.0 1.5 1D2 /\n"
+                             "NEWTRAN\nNOSIM\nUNIFOUT\n";
+
+    struct edit {
+        std::size_t at;
+        std::size_t erase;
+        std::string insert;
+    };
+
+    const std::vector< edit > edits = {
+        { 0, 0, "" },
+        { 0, 7, "GRID" },
+        { 17, 2, "11" },
+        { 17, 2, "1000" },
+        { base.find( "OIL" ), 3, "GAS" },
+        { base.find( "OIL" ), 4, "" },
+        { base.find( "GRID" ), 0, "DIMENS\n 1 2 3 /\n" },
+        { base.find( "NEWTRAN" ), 0, "BROKEN\n" },
+        { base.find( "MAPAXES" ) + 3, 0, "X" },
+        { base.size(), 0, "SCHEDULE\n" },
+        { base.find( "0.0" ), 3, "-- comment /\n 0.0" },
+        { 0, base.size(), "" },
+    };
+
+    for( const auto& e : edits ) {
+        auto input = base;
+        input.replace( e.at, e.erase, e.insert );
+        INFO( input );
+
+        auto deck = lun::track( base.data(), base.data() + base.size() );
+        lun::retrack( deck, base.data(), base.data() + base.size(),
+                            input.data(), input.data() + input.size() );
+        const auto fresh = lun::track( input.data(), input.data() + input.size() );
+
+        CHECK( show( deck.kws ) == show( lun::parse( input ) ) );
+        CHECK( deck.ends == fresh.ends );
+        CHECK( deck.complete == fresh.complete );
+
+        /* and back again, from the broken or changed deck */
+        lun::retrack( deck, input.data(), input.data() + input.size(),
+                            base.data(), base.data() + base.size() );
+        CHECK( show( deck.kws ) == show( lun::parse( base ) ) );
+        CHECK( deck.complete );
+    }
+}
+
+TEST_CASE( "a session follows edits to its files", "[session]" ) {
+    const auto dir = tempdir();
+    const auto root = dir + "/root.data";
+    const auto inc = dir + "/grid.inc";
+
+    std::string grid;
+    for( int i = 0; i < 100; ++i )
+        grid += "MAPAXES\n " + std::to_string( i ) + " 1.5 2* /\n";
+
+    write( root, "RUNSPEC\nDIMENS\n 10 20 30 /\n"
+                 "GRID\nINCLUDE\n 'grid.inc' /\n"
+                 "NEWTRAN\nNOSIM\n" );
+    write( inc, grid );
+
+    lun::session s( root );
+    CHECK( s.complete() );
+    CHECK( s.keywords().size() == 105 );
+    CHECK( s.reparsed() == 105 );
+    CHECK( show( s ) == reparse( s ) );
+
+    CHECK( !s.refresh() );
+
+    SECTION( "only the changed keywords are parsed again" ) {
+        auto changed = grid;
+        changed.replace( changed.find( " 50 " ), 4, " 5000 " );
+        write( inc, changed );
+
+        REQUIRE( s.refresh() );
+        CHECK( show( s ) == reparse( s ) );
+        CHECK( s.reparsed() <= 3 );
+        CHECK( !s.refresh() );
+    }
+
+    SECTION( "new includes are followed" ) {
+        const auto extra = dir + "/extra.inc";
+        write( extra, "OIL\nWATER\n" );
+        write( inc, grid + "INCLUDE\n 'extra.inc' /\n" );
+
+        REQUIRE( s.refresh() );
+        CHECK( s.keywords().size() == 107 );
+        CHECK( show( s ) == reparse( s ) );
+
+        write( extra, "OIL\nWATER\nGAS\n" );
+        REQUIRE( s.refresh() );
+        CHECK( s.keywords().size() == 108 );
+        CHECK( show( s ) == reparse( s ) );
+    }
+
+    SECTION( "a deck that can't be read leaves the session as it was" ) {
+        const auto before = show( s );
+        unlink( inc.c_str() );
+        CHECK_THROWS( s.refresh() );
+        CHECK( show( s ) == before );
+
+        write( inc, grid + "OIL\n" );
+        REQUIRE( s.refresh() );
+        CHECK( show( s ) == reparse( s ) );
+    }
+
+    SECTION( "watch waits for a change" ) {
+        CHECK( !s.watch( 10 ) );
+
+        std::thread editor( [&] {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+            const auto tmp = dir + "/grid.tmp";
+            write( tmp, grid + "OIL\n" );
+            rename( tmp.c_str(), inc.c_str() );
+        } );
+
+        const auto changed = s.watch( 5000 );
+        editor.join();
+        CHECK( changed );
+        CHECK( s.keywords().size() == 106 );
+        CHECK( show( s ) == reparse( s ) );
+    }
+}